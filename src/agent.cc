@@ -0,0 +1,56 @@
+#include "agent.h"
+#include "random.h"
+#include <glm/ext/scalar_constants.hpp>
+#include <algorithm>
+
+Agents generate_agents(unsigned int agent_count, unsigned int seed) {
+  Agents agents;
+  agents.positions.resize(agent_count);
+  agents.headings.resize(agent_count);
+  agents.ids.resize(agent_count);
+
+  for (unsigned int i = 0; i < agent_count; ++i) {
+    unsigned int rand_state = agent_rand_state(i, ~0u, seed);
+    agents.positions[i].x = rand_float(rand_state);
+    agents.positions[i].y = rand_float(rand_state);
+    agents.headings[i] = 2.0f * glm::pi<float>() * rand_float(rand_state);
+    agents.ids[i] = i;
+  }
+
+  return agents;
+}
+
+float wrap_heading(float angle) {
+  constexpr float two_pi = 2.0f * glm::pi<float>();
+  return angle - two_pi * glm::floor(angle / two_pi);
+}
+
+SortGrid make_sort_grid(unsigned int res_x, unsigned int res_y) {
+  constexpr unsigned int max_cells = 256;
+  unsigned int max_res = std::max(res_x, res_y);
+
+  unsigned int cell_size = 16;
+  while ((max_res + cell_size - 1) / cell_size > max_cells) {
+    cell_size *= 2;
+  }
+
+  unsigned int cell_count = (max_res + cell_size - 1) / cell_size;
+  unsigned int bits = 0;
+  while ((1u << bits) < cell_count) {
+    ++bits;
+  }
+
+  return { cell_size, bits };
+}
+
+unsigned int morton_key(glm::vec2 position, glm::uvec2 resolution, SortGrid grid) {
+  glm::uvec2 texel = glm::uvec2(glm::clamp(position, glm::vec2(0.0f), glm::vec2(1.0f)) * glm::vec2(resolution));
+  glm::uvec2 cell = glm::min(texel / grid.cell_size, glm::uvec2((1u << grid.bits) - 1));
+
+  unsigned int key = 0;
+  for (unsigned int bit = 0; bit < grid.bits; ++bit) {
+    key |= ((cell.x >> bit) & 1u) << (2 * bit);
+    key |= ((cell.y >> bit) & 1u) << (2 * bit + 1);
+  }
+  return key;
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+
+// Structure-of-arrays agent storage: a normalised position and a heading angle in radians,
+// 12 bytes per agent. Every agent deposits the same white trail. The ids survive spatial sorting
+// and are only read by the deterministic mode.
+struct Agents {
+  std::vector<glm::vec2> positions;
+  std::vector<float> headings;
+  std::vector<unsigned int> ids;
+
+  std::size_t size() const { return positions.size(); }
+};
+
+// Placement is derived from the seed alone, so a given seed gives the same agents everywhere.
+Agents generate_agents(unsigned int count, unsigned int seed);
+
+// Keeps headings in [0, 2pi) so they don't lose precision over long runs.
+float wrap_heading(float);
+
+// Agents are spatially sorted by the Morton index of the coarse grid cell they are in. Cells are
+// sized so the grid has at most 256 x 256 cells, which keeps the counting sort's bins small.
+struct SortGrid {
+  unsigned int cell_size;
+  unsigned int bits;
+
+  unsigned int bin_count() const { return 1u << (2 * bits); }
+};
+
+SortGrid make_sort_grid(unsigned int res_x, unsigned int res_y);
+unsigned int morton_key(glm::vec2 position, glm::uvec2 resolution, SortGrid);
\ No newline at end of file
@@ -1,50 +1,213 @@
 #include "application.h"
 #include <glm/glm.hpp>
-#include <glm/ext/scalar_constants.hpp>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <fmt/core.h>
 #include <stdexcept>
 #include <vector>
 #include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#ifdef HAS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
 #define WINDOW_TITLE "Mould Simulation"
+#define HEADLESS_DELTA_TIME (1.0f / 60.0f)
+// TILE_SIZE of screen_update_tiled.comp and active_tiles.comp.
+#define SPARSE_TILE_SIZE 16
+
+namespace {
+
+struct TrailFormatInfo {
+  unsigned int internal_format;
+  const char* glsl_format;
+  int channel_count;
+};
+
+TrailFormatInfo trail_format_info(TrailFormat format) {
+  switch (format) {
+    case TrailFormat::r32f: return { GL_R32F, "r32f", 1 };
+    case TrailFormat::r16f: return { GL_R16F, "r16f", 1 };
+    case TrailFormat::r8: return { GL_R8, "r8", 1 };
+    default: return { GL_RGBA32F, "rgba32f", 4 };
+  }
+}
+
+std::string load_trail_shader_source(const std::string& path, TrailFormat format) {
+  auto [internal_format, glsl_format, channel_count] = trail_format_info(format);
+  return Shader::insert_defines(Shader::load_source_from_file(path), {
+    fmt::format("TRAIL_FORMAT {}", glsl_format),
+    fmt::format("TRAIL_CHANNELS {}", channel_count),
+  });
+}
+
+// Counting agents per texel needs 32 bit atomics, marking them needs a byte.
+unsigned int deposit_texture_format(DepositMode mode) {
+  return (mode == DepositMode::accumulate ? GL_R32UI : GL_R8UI);
+}
+
+std::string insert_deposit_defines(const std::string& source, DepositMode mode) {
+  if (mode == DepositMode::accumulate) {
+    return Shader::insert_defines(source, { "FUSED_DEPOSIT", "ACCUMULATE_DEPOSIT", "DEPOSIT_FORMAT r32ui" });
+  }
+  return Shader::insert_defines(source, { "FUSED_DEPOSIT" });
+}
+
+}
 
 Application::Application(const ApplicationConfig& _config) : config { _config } {
-  init_context();
-  init_imgui();
-  init_screen_quad();
-  init_screen_quad_shader();
-  init_agents_ssbo();
-  init_agents_update_shader();
-  init_screen_textures();
-  init_screen_update_shader();
+  if (config.headless && config.frame_limit == 0) {
+    throw std::runtime_error("A headless run needs a frame_limit.");
+  }
+
+  std::optional<CheckpointFile> checkpoint;
+  if (!config.restore_path.empty()) {
+    checkpoint.emplace(config.restore_path);
+    checkpoint->apply_to(config);
+  }
+
+  if (config.deterministic) {
+    if (config.fixed_dt <= 0.0f) {
+      config.fixed_dt = HEADLESS_DELTA_TIME / std::max(config.substeps, 1u);
+    }
+  } else if (!checkpoint) {
+    std::random_device dev;
+    config.seed = dev();
+  }
+
+  if (config.deposit_mode == DepositMode::accumulate) {
+    config.fused_pipeline = true;
+  }
+
+  if (!config.headless) {
+    init_context();
+  } else if (config.backend == Backend::gpu && !init_headless_context()) {
+    fmt::println("No offscreen OpenGL context available, falling back to the CPU backend.");
+    config.backend = Backend::cpu;
+  }
+
+  if (has_gl_context) {
+    if (!config.program_cache_dir.empty()) {
+      program_cache = std::make_unique<ProgramCache>(config.program_cache_dir);
+    }
+    init_screen_textures();
+    if (config.profile_gpu) {
+      gpu_profiler = std::make_unique<GpuProfiler>(config.profile_csv_path);
+    }
+  }
+
+  if (!config.headless) {
+    init_imgui();
+    init_screen_quad();
+    init_screen_quad_shader();
+  }
+
+  if (config.backend == Backend::cpu) {
+    cpu_engine = std::make_unique<CpuEngine>(config);
+  } else {
+    init_agents_ssbos();
+    if (config.fused_pipeline) {
+      init_deposit_textures();
+    }
+    init_simulation_params_ubo();
+    init_agents_update_shader();
+    init_screen_update_shader();
+    if (config.sparse_tiles) {
+      init_sparse_tiles();
+    }
+    if (config.deterministic && !config.fused_pipeline) {
+      init_agents_deposit_shader();
+    }
+    if (config.sort_interval != 0) {
+      init_agents_sort();
+    }
+  }
+
+  if (!config.record_path.empty()) {
+    frame_recorder = std::make_unique<FrameRecorder>(config.record_path, config.record_format, config.sim_res_x, config.sim_res_y);
+  }
+
+  if (checkpoint) {
+    restore_checkpoint(*checkpoint);
+  }
 }
 
 Application::~Application() {
-  glDeleteVertexArrays(1, &screen_quad_vao);
-  glDeleteBuffers(1, &screen_quad_vbo);
-  glDeleteBuffers(1, &scree_quad_ebo);
-  screen_quad_shader.reset();
+  if (has_gl_context) {
+    glDeleteVertexArrays(1, &screen_quad_vao);
+    glDeleteBuffers(1, &screen_quad_vbo);
+    glDeleteBuffers(1, &scree_quad_ebo);
+    screen_quad_shader.reset();
+
+    glDeleteBuffers(1, &agent_positions_ssbo);
+    glDeleteBuffers(1, &agent_headings_ssbo);
+    glDeleteBuffers(1, &agent_ids_ssbo);
+    glDeleteBuffers(1, &sorted_positions_ssbo);
+    glDeleteBuffers(1, &sorted_headings_ssbo);
+    glDeleteBuffers(1, &sorted_ids_ssbo);
+    glDeleteBuffers(1, &sort_bins_ssbo);
+    glDeleteBuffers(1, &sort_keys_ssbo);
+    agents_sort_histogram_shader.reset();
+    agents_sort_scan_shader.reset();
+    agents_sort_scatter_shader.reset();
+    glDeleteBuffers(1, &simulation_params_ubo);
+    agents_update_shader.reset();
+    agents_deposit_shader.reset();
+
+    glDeleteTextures(2, screen_textures.data());
+    glDeleteTextures(2, deposit_textures.data());
+    screen_update_shader.reset();
+    glDeleteBuffers(1, &tile_occupancy_ssbo);
+    glDeleteBuffers(1, &active_tiles_ssbo);
+    active_tiles_shader.reset();
+
+    gpu_profiler.reset();
+    frame_recorder.reset();
+
+    if (pending_checkpoint) {
+      collect_checkpoint(true);
+    }
+  }
 
-  glDeleteBuffers(1, &agents_ssbo);
-  agents_update_shader.reset();
+  if (window != nullptr) {
+    ImGui_ImplOpenGL3_Shutdown();
+    ImGui_ImplGlfw_Shutdown();
+    ImGui::DestroyContext();
 
-  glDeleteTextures(2, screen_textures.data());
-  screen_update_shader.reset();
+    glfwTerminate();
+  }
 
-  ImGui_ImplOpenGL3_Shutdown();
-  ImGui_ImplGlfw_Shutdown();
-  ImGui::DestroyContext();
+  if (checkpoint_writer.joinable()) {
+    checkpoint_writer.join();
+  }
 
-  glfwTerminate();
+#ifdef HAS_EGL
+  if (egl_display != nullptr) {
+    eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(egl_display, egl_context);
+    eglTerminate(egl_display);
+  }
+#endif
 }
 
 void Application::run() {
+  if (config.headless) {
+    run_headless();
+    return;
+  }
+
   while (!glfwWindowShouldClose(window)) {
+    if (config.frame_limit != 0 && frame_count >= static_cast<int>(config.frame_limit)) {
+      break;
+    }
+
     glfwPollEvents();
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
@@ -56,17 +219,20 @@ void Application::run() {
     prev_time = current_time;
     ++frame_count;
     // delta_time = 1.0f / 144.0f;
+    if (gpu_profiler) {
+      gpu_profiler->begin_frame(frame_count);
+    }
 
     update_title();
     process_input();
 
-    dispatch_agents_update_shader();
-    dispatch_screen_update_shader();
-    glCopyImageSubData(
-      screen_textures[0], GL_TEXTURE_2D, 0, 0, 0, 0,
-      screen_textures[1], GL_TEXTURE_2D, 0, 0, 0, 0,
-      config.sim_res_x, config.sim_res_y, 1
-    );
+    update_simulation();
+    if (frame_recorder) {
+      record_frame();
+    }
+    if (!config.checkpoint_path.empty()) {
+      update_checkpoints();
+    }
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
@@ -77,10 +243,253 @@ void Application::run() {
     }
 
     ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    {
+      GpuProfiler::Scope scope { gpu_profiler.get(), GpuPass::imgui };
+      ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    }
 
     glfwSwapBuffers(window);
   }
+
+  if (!config.checkpoint_path.empty()) {
+    save_checkpoint();
+  }
+}
+
+void Application::run_headless() {
+  delta_time = HEADLESS_DELTA_TIME;
+
+  int start_frame_count = frame_count;
+  unsigned int start_step_count = step_count;
+  auto start_time = std::chrono::steady_clock::now();
+  while (frame_count < static_cast<int>(config.frame_limit)) {
+    ++frame_count;
+    if (gpu_profiler) {
+      gpu_profiler->begin_frame(frame_count);
+    }
+    update_simulation();
+    if (frame_recorder) {
+      record_frame();
+    }
+    if (!config.checkpoint_path.empty()) {
+      update_checkpoints();
+    }
+  }
+
+  if (has_gl_context) {
+    glFinish();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+  int frames = frame_count - start_frame_count;
+  unsigned int steps = step_count - start_step_count;
+  fmt::println(
+    "{} frames ({} steps) in {:.3f}s [{:.1f} FPS, {:.1f} steps/s]",
+    frames, steps, elapsed.count(), frames / elapsed.count(), steps / elapsed.count()
+  );
+
+  if (!config.checkpoint_path.empty()) {
+    save_checkpoint();
+  }
+
+  const char* cpu_kernels = (cpu_engine ? cpu_engine->cpu_kernels_name() : "none");
+  last_run_stats = { config.backend, cpu_kernels, frames, steps, elapsed.count(), {} };
+  if (gpu_profiler) {
+    gpu_profiler->begin_frame(frame_count);
+    for (std::size_t i = 0; i < gpu_pass_count; ++i) {
+      auto pass = static_cast<GpuPass>(i);
+      auto [sample_count, mean_ms, p50_ms, p95_ms, p99_ms] = gpu_profiler->stats(pass);
+      if (sample_count == 0) continue;
+      last_run_stats.passes.push_back({ GpuProfiler::pass_name(pass), sample_count, mean_ms });
+      fmt::println(
+        "  {:<14} mean {:.3f}ms  p50 {:.3f}ms  p95 {:.3f}ms  p99 {:.3f}ms",
+        GpuProfiler::pass_name(pass), mean_ms, p50_ms, p95_ms, p99_ms
+      );
+    }
+  }
+
+  if (cpu_engine) {
+    for (std::size_t i = 0; i < cpu_pass_count; ++i) {
+      auto pass = static_cast<CpuPass>(i);
+      auto [count, seconds] = cpu_engine->pass_time(pass);
+      if (count == 0) continue;
+      double mean_ms = 1000.0 * seconds / count;
+      last_run_stats.passes.push_back({ CpuEngine::pass_name(pass), count, mean_ms });
+      fmt::println("  {:<14} mean {:.3f}ms", CpuEngine::pass_name(pass), mean_ms);
+    }
+  }
+}
+
+const RunStats& Application::run_stats() const {
+  return last_run_stats;
+}
+
+bool Application::has_gpu_context() const {
+  return has_gl_context && config.backend == Backend::gpu;
+}
+
+void Application::update_simulation() {
+  unsigned int substeps = std::max(config.substeps, 1u);
+  step_delta_time = (config.fixed_dt > 0.0f ? config.fixed_dt : delta_time / substeps);
+  if (config.backend == Backend::gpu) {
+    upload_simulation_params();
+  }
+
+  for (unsigned int i = 0; i < substeps; ++i) {
+    step_simulation();
+  }
+
+  if (config.backend == Backend::cpu && !config.headless) {
+    upload_cpu_trail_map();
+  }
+}
+
+void Application::step_simulation() {
+  ++step_count;
+  if (config.backend == Backend::cpu) {
+    cpu_engine->step(config, step_delta_time);
+    return;
+  }
+
+  if (config.sort_interval != 0 && step_count % config.sort_interval == 0) {
+    dispatch_agents_sort_shaders();
+  }
+  if (config.sparse_tiles) {
+    bind_tile_occupancy();
+  }
+  dispatch_agents_update_shader();
+  if (config.deterministic && !config.fused_pipeline) {
+    dispatch_agents_deposit_shader();
+  }
+  dispatch_screen_update_shader();
+  current_screen_texture ^= 1;
+}
+
+// The CPU trail map is recorded straight from memory, the GPU one is read back asynchronously.
+void Application::record_frame() {
+  if (config.backend == Backend::cpu) {
+    frame_recorder->capture_pixels(cpu_engine->trail_map());
+  } else {
+    frame_recorder->capture_texture(screen_textures[current_screen_texture]);
+  }
+}
+
+void Application::update_checkpoints() {
+  if (pending_checkpoint) {
+    collect_checkpoint(false);
+  }
+  if (config.checkpoint_interval != 0 && frame_count % config.checkpoint_interval == 0) {
+    save_checkpoint();
+  }
+}
+
+void Application::save_checkpoint() {
+  if (pending_checkpoint) {
+    collect_checkpoint(true);
+  }
+
+  unsigned int trail_channels = (config.backend == Backend::cpu ? 1 : trail_format_info(config.trail_format).channel_count);
+  auto header = make_checkpoint_header(config, trail_channels);
+  header.frame_count = frame_count;
+  header.step_count = step_count;
+
+  if (config.backend == Backend::cpu) {
+    const auto& agents = cpu_engine->current_agents();
+    const auto& trail_map = cpu_engine->trail_map();
+    std::vector<std::byte> data(header.file_size);
+    std::memcpy(&data[0], &header, sizeof(header));
+    std::memcpy(&data[header.positions_offset], agents.positions.data(), agents.positions.size() * sizeof(glm::vec2));
+    std::memcpy(&data[header.headings_offset], agents.headings.data(), agents.headings.size() * sizeof(float));
+    std::memcpy(&data[header.ids_offset], agents.ids.data(), agents.ids.size() * sizeof(unsigned int));
+    std::memcpy(&data[header.trail_offset], trail_map.data(), trail_map.size() * sizeof(float));
+    write_checkpoint_async(std::move(data));
+    return;
+  }
+
+  // The staging buffer has the layout of the file, so it is written out with a single copy.
+  unsigned int staging_buffer;
+  glCreateBuffers(1, &staging_buffer);
+  glNamedBufferStorage(staging_buffer, header.file_size, nullptr, GL_MAP_READ_BIT);
+
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+  std::size_t agent_count = config.agent_count;
+  glCopyNamedBufferSubData(agent_positions_ssbo, staging_buffer, 0, header.positions_offset, agent_count * sizeof(glm::vec2));
+  glCopyNamedBufferSubData(agent_headings_ssbo, staging_buffer, 0, header.headings_offset, agent_count * sizeof(float));
+  glCopyNamedBufferSubData(agent_ids_ssbo, staging_buffer, 0, header.ids_offset, agent_count * sizeof(unsigned int));
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, staging_buffer);
+  glGetTextureImage(
+    screen_textures[current_screen_texture], 0, (trail_channels == 1 ? GL_RED : GL_RGBA), GL_FLOAT,
+    header.file_size - header.trail_offset, reinterpret_cast<void*>(header.trail_offset)
+  );
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  pending_checkpoint = PendingCheckpoint { header, staging_buffer, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) };
+}
+
+void Application::collect_checkpoint(bool wait) {
+  auto [header, staging_buffer, fence] = *pending_checkpoint;
+  GLuint64 timeout = (wait ? GL_TIMEOUT_IGNORED : 0);
+  if (glClientWaitSync(static_cast<GLsync>(fence), GL_SYNC_FLUSH_COMMANDS_BIT, timeout) == GL_TIMEOUT_EXPIRED) return;
+  glDeleteSync(static_cast<GLsync>(fence));
+
+  std::vector<std::byte> data(header.file_size);
+  auto mapped = static_cast<const std::byte*>(glMapNamedBufferRange(staging_buffer, 0, header.file_size, GL_MAP_READ_BIT));
+  std::memcpy(&data[header.positions_offset], &mapped[header.positions_offset], header.file_size - header.positions_offset);
+  glUnmapNamedBuffer(staging_buffer);
+  glDeleteBuffers(1, &staging_buffer);
+  std::memcpy(&data[0], &header, sizeof(header));
+
+  pending_checkpoint.reset();
+  write_checkpoint_async(std::move(data));
+}
+
+// Only one checkpoint is written at a time, so a slow disk delays the next one instead of
+// letting them pile up in memory.
+void Application::write_checkpoint_async(std::vector<std::byte> data) {
+  if (checkpoint_writer.joinable()) {
+    checkpoint_writer.join();
+  }
+
+  checkpoint_writer = std::thread { [path = config.checkpoint_path, data = std::move(data)] {
+    try {
+      write_checkpoint(path, data);
+    } catch (const std::exception& e) {
+      fmt::println("{}", e.what());
+    }
+  } };
+}
+
+void Application::restore_checkpoint(const CheckpointFile& checkpoint) {
+  const auto& header = checkpoint.header();
+  frame_count = header.frame_count;
+  step_count = header.step_count;
+
+  std::size_t agent_count = header.agent_count;
+  if (config.backend == Backend::cpu) {
+    Agents agents;
+    agents.positions.assign(checkpoint.positions(), checkpoint.positions() + agent_count);
+    agents.headings.assign(checkpoint.headings(), checkpoint.headings() + agent_count);
+    agents.ids.assign(checkpoint.ids(), checkpoint.ids() + agent_count);
+    cpu_engine->restore(std::move(agents), checkpoint.convert_trail_map(1), step_count);
+    return;
+  }
+
+  glNamedBufferSubData(agent_positions_ssbo, 0, agent_count * sizeof(glm::vec2), checkpoint.positions());
+  glNamedBufferSubData(agent_headings_ssbo, 0, agent_count * sizeof(float), checkpoint.headings());
+  glNamedBufferSubData(agent_ids_ssbo, 0, agent_count * sizeof(unsigned int), checkpoint.ids());
+
+  // A trail map saved with the other channel count has to be converted first.
+  unsigned int trail_channels = trail_format_info(config.trail_format).channel_count;
+  std::vector<float> converted_trail_map;
+  const float* trail_map = checkpoint.trail_map();
+  if (header.trail_channels != trail_channels) {
+    converted_trail_map = checkpoint.convert_trail_map(trail_channels);
+    trail_map = converted_trail_map.data();
+  }
+  glTextureSubImage2D(
+    screen_textures[current_screen_texture], 0, 0, 0, config.sim_res_x, config.sim_res_y,
+    (trail_channels == 1 ? GL_RED : GL_RGBA), GL_FLOAT, trail_map
+  );
 }
 
 void Application::init_context() {
@@ -107,6 +516,64 @@ void Application::init_context() {
   }
 
   glViewport(0, 0, config.window_x, config.window_y);
+  has_gl_context = true;
+}
+
+bool Application::init_headless_context() {
+#ifdef HAS_EGL
+  // Prefer Mesa's surfaceless platform, which needs neither a display server nor a GPU driver
+  // that exposes a default display.
+  auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  EGLDisplay display = EGL_NO_DISPLAY;
+  if (get_platform_display != nullptr) {
+    display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+  }
+  if (display == EGL_NO_DISPLAY) {
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+    return false;
+  }
+
+  constexpr EGLint config_attribs[] = {
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_NONE
+  };
+  EGLConfig egl_config = nullptr;
+  EGLint config_count = 0;
+  eglChooseConfig(display, config_attribs, &egl_config, 1, &config_count);
+
+  constexpr EGLint context_attribs[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 4,
+    EGL_CONTEXT_MINOR_VERSION, 5,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+  EGLContext context = EGL_NO_CONTEXT;
+  if (eglBindAPI(EGL_OPENGL_API)) {
+    context = eglCreateContext(display, (config_count > 0 ? egl_config : EGL_NO_CONFIG_KHR), EGL_NO_CONTEXT, context_attribs);
+  }
+  if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+    if (context != EGL_NO_CONTEXT) {
+      eglDestroyContext(display, context);
+    }
+    eglTerminate(display);
+    return false;
+  }
+
+  egl_display = display;
+  egl_context = context;
+
+  int version = gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress));
+  if (version == 0) {
+    throw std::runtime_error("Failed to initialize OpenGL context.");
+  }
+
+  has_gl_context = true;
+  return true;
+#else
+  return false;
+#endif
 }
 
 void Application::init_imgui() {
@@ -128,7 +595,36 @@ void Application::render_ui() {
   ImGui::SliderFloat("Sensor Span", &config.sensor_span, 0.0, 180.0);
   ImGui::SliderFloat("Sensor Range", &config.sensor_range, 0.0, 0.1);
   ImGui::SliderInt("Sensor Size", &config.sensor_size, 0, 3);
+  if (config.deposit_mode == DepositMode::accumulate) {
+    ImGui::SliderFloat("Deposit Amount", &config.deposit_amount, 0.0, 1.0);
+  }
   ImGui::End();
+
+  if (gpu_profiler) {
+    ImGui::Begin("GPU Profiler");
+    if (ImGui::BeginTable("passes", 5)) {
+      ImGui::TableSetupColumn("Pass");
+      ImGui::TableSetupColumn("Mean");
+      ImGui::TableSetupColumn("P50");
+      ImGui::TableSetupColumn("P95");
+      ImGui::TableSetupColumn("P99");
+      ImGui::TableHeadersRow();
+      for (std::size_t i = 0; i < gpu_pass_count; ++i) {
+        auto pass = static_cast<GpuPass>(i);
+        auto [sample_count, mean_ms, p50_ms, p95_ms, p99_ms] = gpu_profiler->stats(pass);
+        if (sample_count == 0) continue;
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(GpuProfiler::pass_name(pass));
+        for (double ms : { mean_ms, p50_ms, p95_ms, p99_ms }) {
+          ImGui::TableNextColumn();
+          ImGui::Text("%.3f ms", ms);
+        }
+      }
+      ImGui::EndTable();
+    }
+    ImGui::End();
+  }
 }
 
 void Application::init_screen_quad() {
@@ -163,18 +659,21 @@ void Application::init_screen_quad() {
 void Application::init_screen_quad_shader() {
   auto vertex_shader_source = Shader::load_source_from_file("shaders/screen_quad.vert");
   auto fragment_shader_source = Shader::load_source_from_file("shaders/screen_quad.frag");
-  Shader vertex_shader { vertex_shader_source, GL_VERTEX_SHADER };
-  Shader fragment_shader { fragment_shader_source, GL_FRAGMENT_SHADER };
-  screen_quad_shader = std::make_unique<GraphicsShaderProgram>(vertex_shader, fragment_shader);
+  screen_quad_shader = std::make_unique<GraphicsShaderProgram>(vertex_shader_source, fragment_shader_source, program_cache.get());
 }
 
 void Application::render_screen_quad() const {
+  GpuProfiler::Scope scope { gpu_profiler.get(), GpuPass::screen_quad };
   screen_quad_shader->use();
+  glBindTextureUnit(0, screen_textures[current_screen_texture]);
   glBindVertexArray(screen_quad_vao);
   glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
 }
 
 void Application::init_screen_textures() {
+  auto [internal_format, glsl_format, channel_count] = trail_format_info(config.trail_format);
+  bool is_single_channel = (channel_count == 1 || config.backend == Backend::cpu);
+
   glGenTextures(2, screen_textures.data());
   for (std::size_t i = 0; i < screen_textures.size(); ++i) {
     glActiveTexture(GL_TEXTURE0 + i);
@@ -183,88 +682,287 @@ void Application::init_screen_textures() {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, config.sim_res_x, config.sim_res_y, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glBindImageTexture(i, screen_textures[i], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, config.sim_res_x, config.sim_res_y, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glClearTexImage(screen_textures[i], 0, GL_RGBA, GL_FLOAT, nullptr);
+    if (is_single_channel) {
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+    }
   }
 }
 
-void Application::init_agents_ssbo() {
-  struct alignas(16) Agent {
-    glm::vec2 position;
-    glm::vec2 direction;
-    glm::vec3 color;
-  };
+void Application::init_deposit_textures() {
+  unsigned int deposit_format = deposit_texture_format(config.deposit_mode);
+  glCreateTextures(GL_TEXTURE_2D, 2, deposit_textures.data());
+  for (auto texture : deposit_textures) {
+    glTextureStorage2D(texture, 1, deposit_format, config.sim_res_x, config.sim_res_y);
+    glClearTexImage(texture, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  }
+}
 
-  std::vector<Agent> agents(config.agent_count);
-  std::random_device dev;
-  std::mt19937 rng { dev() };
-  std::uniform_real_distribution<float> dist;
-  for (auto& [pos, dir, color] : agents) {
-    pos = { dist(rng), dist(rng) };
+void Application::init_agents_ssbos() {
+  Agents agents = generate_agents(config.agent_count, config.seed);
+
+  glGenBuffers(1, &agent_positions_ssbo);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, agent_positions_ssbo);
+  std::size_t positions_size = agents.positions.size() * sizeof(glm::vec2);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, positions_size, agents.positions.data(), GL_DYNAMIC_COPY);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, agent_positions_ssbo);
+
+  glGenBuffers(1, &agent_headings_ssbo);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, agent_headings_ssbo);
+  std::size_t headings_size = agents.headings.size() * sizeof(float);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, headings_size, agents.headings.data(), GL_DYNAMIC_COPY);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, agent_headings_ssbo);
+
+  glGenBuffers(1, &agent_ids_ssbo);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, agent_ids_ssbo);
+  std::size_t ids_size = agents.ids.size() * sizeof(unsigned int);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, ids_size, agents.ids.data(), GL_DYNAMIC_COPY);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, agent_ids_ssbo);
+}
+
+void Application::upload_cpu_trail_map() const {
+  GpuProfiler::Scope scope { gpu_profiler.get(), GpuPass::trail_upload };
+  glTextureSubImage2D(
+    screen_textures[0], 0, 0, 0, config.sim_res_x, config.sim_res_y,
+    GL_RED, GL_FLOAT, cpu_engine->trail_map().data()
+  );
+}
 
-    float angle = 2.0f * glm::pi<float>() * dist(rng);
-    dir = { glm::cos(angle), glm::sin(angle) };
+void Application::init_simulation_params_ubo() {
+  glGenBuffers(1, &simulation_params_ubo);
+  glBindBuffer(GL_UNIFORM_BUFFER, simulation_params_ubo);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(SimulationParams), nullptr, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, 0, simulation_params_ubo);
+}
+
+void Application::upload_simulation_params() {
+  SimulationParams params {
+    .resolution = glm::ivec2(config.sim_res_x, config.sim_res_y),
+    .agent_count = config.agent_count,
+    .agent_speed = config.agent_speed,
+    .turn_speed = config.turn_speed,
+    .sensor_span = glm::radians(config.sensor_span),
+    .sensor_range = config.sensor_range,
+    .sensor_size = config.sensor_size,
+    .diffuse_rate = config.diffuse_rate,
+    .evaporate_rate = config.evaporate_rate,
+    .dt = step_delta_time,
+    .seed = config.seed,
+    .deposit_amount = config.deposit_amount,
+  };
 
-    color = glm::vec3(1.0f);
-    // color = glm::mix(glm::vec3(1.0f, 0.5f, 0.25f), glm::vec3(0.25f, 1.0f, 0.7f), glm::length(pos - glm::vec2(0.5f)) / glm::sqrt(2.0f));
+  if (uploaded_params && std::memcmp(&params, &*uploaded_params, sizeof(SimulationParams)) == 0) {
+    return;
   }
 
-  glGenBuffers(1, &agents_ssbo);
-  glBindBuffer(GL_SHADER_STORAGE_BUFFER, agents_ssbo);
-  std::size_t buffer_size = agents.size() * sizeof(Agent);
-  glBufferData(GL_SHADER_STORAGE_BUFFER, buffer_size, agents.data(), GL_DYNAMIC_COPY);
-  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, agents_ssbo);
+  glNamedBufferSubData(simulation_params_ubo, 0, sizeof(SimulationParams), &params);
+  uploaded_params = params;
 }
 
 void Application::init_agents_update_shader() {
-  auto compute_shader_source = Shader::load_source_from_file("shaders/agents_update.comp");
-  Shader compute_shader { compute_shader_source, GL_COMPUTE_SHADER };
-  agents_update_shader = std::make_unique<ComputeShaderProgram>(compute_shader);
+  auto compute_shader_source = load_trail_shader_source("shaders/agents_update.comp", config.trail_format);
+  if (config.deterministic) {
+    compute_shader_source = Shader::insert_defines(compute_shader_source, { "DETERMINISTIC" });
+  }
+  if (config.fused_pipeline) {
+    compute_shader_source = insert_deposit_defines(compute_shader_source, config.deposit_mode);
+  }
+  if (config.sparse_tiles) {
+    compute_shader_source = Shader::insert_defines(compute_shader_source, { "SPARSE_TILES" });
+  }
+  agents_update_shader = std::make_unique<ComputeShaderProgram>(compute_shader_source, program_cache.get());
 }
 
 void Application::dispatch_agents_update_shader() const {
+  GpuProfiler::Scope scope { gpu_profiler.get(), GpuPass::agents_update };
   agents_update_shader->use();
-  static int seed = [] {
-    std::random_device dev;
-    std::mt19937 rng { dev() };
-    std::uniform_int_distribution<int> dist;
-    return dist(rng);
-  } ();
-  agents_update_shader->set_uniform("seed", seed);
-  agents_update_shader->set_uniform("frame_count", frame_count);
-  agents_update_shader->set_uniform("resolution", glm::ivec2(config.sim_res_x, config.sim_res_y));
-  agents_update_shader->set_uniform("agent_count", config.agent_count);
-  agents_update_shader->set_uniform("agent_speed", config.agent_speed);
-  agents_update_shader->set_uniform("turn_speed", config.turn_speed);
-  agents_update_shader->set_uniform("sensor_span", glm::radians(config.sensor_span));
-  agents_update_shader->set_uniform("sensor_range", config.sensor_range);
-  agents_update_shader->set_uniform("sensor_size", config.sensor_size);
-  agents_update_shader->set_uniform("dt", delta_time);
+  agents_update_shader->set_uniform("step_count", step_count);
+
+  unsigned int internal_format = trail_format_info(config.trail_format).internal_format;
+  glBindImageTexture(0, screen_textures[current_screen_texture], 0, GL_FALSE, 0, GL_READ_WRITE, internal_format);
+  if (config.fused_pipeline) {
+    unsigned int deposit_format = deposit_texture_format(config.deposit_mode);
+    glBindImageTexture(2, deposit_textures[step_count % 2], 0, GL_FALSE, 0, GL_READ_WRITE, deposit_format);
+  }
 
   static unsigned int local_group_size = agents_update_shader->local_group_size().x;
   unsigned int group_count = (config.agent_count + local_group_size - 1) / local_group_size;
   glDispatchCompute(group_count, 1, 1);
-  glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void Application::init_agents_sort() {
+  sort_grid = make_sort_grid(config.sim_res_x, config.sim_res_y);
+
+  std::size_t agent_count = config.agent_count;
+  glCreateBuffers(1, &sorted_positions_ssbo);
+  glNamedBufferData(sorted_positions_ssbo, agent_count * sizeof(glm::vec2), nullptr, GL_DYNAMIC_COPY);
+  glCreateBuffers(1, &sorted_headings_ssbo);
+  glNamedBufferData(sorted_headings_ssbo, agent_count * sizeof(float), nullptr, GL_DYNAMIC_COPY);
+  glCreateBuffers(1, &sorted_ids_ssbo);
+  glNamedBufferData(sorted_ids_ssbo, agent_count * sizeof(unsigned int), nullptr, GL_DYNAMIC_COPY);
+  glCreateBuffers(1, &sort_bins_ssbo);
+  glNamedBufferData(sort_bins_ssbo, sort_grid.bin_count() * sizeof(unsigned int), nullptr, GL_DYNAMIC_COPY);
+  glCreateBuffers(1, &sort_keys_ssbo);
+  glNamedBufferData(sort_keys_ssbo, agent_count * sizeof(glm::uvec2), nullptr, GL_DYNAMIC_COPY);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, sort_bins_ssbo);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, sort_keys_ssbo);
+
+  auto histogram_source = Shader::load_source_from_file("shaders/agents_sort_histogram.comp");
+  agents_sort_histogram_shader = std::make_unique<ComputeShaderProgram>(histogram_source, program_cache.get());
+  auto scan_source = Shader::load_source_from_file("shaders/agents_sort_scan.comp");
+  agents_sort_scan_shader = std::make_unique<ComputeShaderProgram>(scan_source, program_cache.get());
+  auto scatter_source = Shader::load_source_from_file("shaders/agents_sort_scatter.comp");
+  agents_sort_scatter_shader = std::make_unique<ComputeShaderProgram>(scatter_source, program_cache.get());
+}
+
+void Application::dispatch_agents_sort_shaders() {
+  GpuProfiler::Scope scope { gpu_profiler.get(), GpuPass::agents_sort };
+  glClearNamedBufferData(sort_bins_ssbo, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, sorted_positions_ssbo);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, sorted_headings_ssbo);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, sorted_ids_ssbo);
+
+  static unsigned int local_group_size = agents_sort_histogram_shader->local_group_size().x;
+  unsigned int group_count = (config.agent_count + local_group_size - 1) / local_group_size;
+
+  agents_sort_histogram_shader->use();
+  agents_sort_histogram_shader->set_uniform("sort_cell_size", sort_grid.cell_size);
+  agents_sort_histogram_shader->set_uniform("sort_bits", sort_grid.bits);
+  glDispatchCompute(group_count, 1, 1);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  agents_sort_scan_shader->use();
+  agents_sort_scan_shader->set_uniform("bin_count", sort_grid.bin_count());
+  glDispatchCompute(1, 1, 1);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  agents_sort_scatter_shader->use();
+  glDispatchCompute(group_count, 1, 1);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  std::swap(agent_positions_ssbo, sorted_positions_ssbo);
+  std::swap(agent_headings_ssbo, sorted_headings_ssbo);
+  std::swap(agent_ids_ssbo, sorted_ids_ssbo);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, agent_positions_ssbo);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, agent_headings_ssbo);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, agent_ids_ssbo);
+}
+
+void Application::init_agents_deposit_shader() {
+  auto compute_shader_source = load_trail_shader_source("shaders/agents_deposit.comp", config.trail_format);
+  if (config.sparse_tiles) {
+    compute_shader_source = Shader::insert_defines(compute_shader_source, { "SPARSE_TILES" });
+  }
+  agents_deposit_shader = std::make_unique<ComputeShaderProgram>(compute_shader_source, program_cache.get());
+}
+
+void Application::dispatch_agents_deposit_shader() const {
+  GpuProfiler::Scope scope { gpu_profiler.get(), GpuPass::agents_deposit };
+  agents_deposit_shader->use();
+
+  unsigned int internal_format = trail_format_info(config.trail_format).internal_format;
+  glBindImageTexture(0, screen_textures[current_screen_texture], 0, GL_FALSE, 0, GL_WRITE_ONLY, internal_format);
+
+  static unsigned int local_group_size = agents_deposit_shader->local_group_size().x;
+  unsigned int group_count = (config.agent_count + local_group_size - 1) / local_group_size;
+  glDispatchCompute(group_count, 1, 1);
+  glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
 }
 
 void Application::init_screen_update_shader() {
-  auto compute_shader_source = Shader::load_source_from_file("shaders/screen_update.comp");
-  Shader compute_shader { compute_shader_source, GL_COMPUTE_SHADER };
-  screen_update_shader = std::make_unique<ComputeShaderProgram>(compute_shader);
+  bool is_tiled = (config.tiled_diffusion || config.fused_pipeline || config.sparse_tiles);
+  const char* path = (is_tiled ? "shaders/screen_update_tiled.comp" : "shaders/screen_update.comp");
+  auto compute_shader_source = load_trail_shader_source(path, config.trail_format);
+  if (config.fused_pipeline) {
+    compute_shader_source = insert_deposit_defines(compute_shader_source, config.deposit_mode);
+  }
+  if (config.sparse_tiles) {
+    compute_shader_source = Shader::insert_defines(compute_shader_source, { "SPARSE_TILES" });
+  }
+  screen_update_shader = std::make_unique<ComputeShaderProgram>(compute_shader_source, program_cache.get());
 }
 
 void Application::dispatch_screen_update_shader() const {
+  GpuProfiler::Scope scope { gpu_profiler.get(), GpuPass::screen_update };
   screen_update_shader->use();
-  screen_update_shader->set_uniform("resolution", glm::ivec2(config.sim_res_x, config.sim_res_y));
-  screen_update_shader->set_uniform("diffuse_rate", config.diffuse_rate);
-  screen_update_shader->set_uniform("evaporate_rate", config.evaporate_rate);
-  screen_update_shader->set_uniform("dt", delta_time);
+
+  unsigned int internal_format = trail_format_info(config.trail_format).internal_format;
+  unsigned int next_screen_texture = current_screen_texture ^ 1;
+  glBindImageTexture(0, screen_textures[current_screen_texture], 0, GL_FALSE, 0, GL_READ_ONLY, internal_format);
+  glBindImageTexture(1, screen_textures[next_screen_texture], 0, GL_FALSE, 0, GL_WRITE_ONLY, internal_format);
+  if (config.fused_pipeline) {
+    unsigned int deposit_format = deposit_texture_format(config.deposit_mode);
+    glBindImageTexture(2, deposit_textures[step_count % 2], 0, GL_FALSE, 0, GL_READ_ONLY, deposit_format);
+    glBindImageTexture(3, deposit_textures[(step_count + 1) % 2], 0, GL_FALSE, 0, GL_WRITE_ONLY, deposit_format);
+  }
+
+  if (config.sparse_tiles) {
+    dispatch_active_tiles_shader();
+    screen_update_shader->use();
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, active_tiles_ssbo);
+    glDispatchComputeIndirect(0);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    return;
+  }
 
   static glm::ivec3 local_group_size = screen_update_shader->local_group_size();
   unsigned int group_count_x = (config.sim_res_x + local_group_size.x - 1) / local_group_size.x;
   unsigned int group_count_y = (config.sim_res_y + local_group_size.y - 1) / local_group_size.y;
   glDispatchCompute(group_count_x, group_count_y, 1);
-  glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+// Step n marks deposits in flag set n % 3, the set after it is written by the diffusion and
+// becomes the next step's occupied tiles, and the last holds the stale ones. Every tile starts
+// out occupied and stale, so the first steps diffuse the whole map and find out which tiles hold
+// trail.
+void Application::init_sparse_tiles() {
+  unsigned int tile_count_x = (config.sim_res_x + SPARSE_TILE_SIZE - 1) / SPARSE_TILE_SIZE;
+  unsigned int tile_count_y = (config.sim_res_y + SPARSE_TILE_SIZE - 1) / SPARSE_TILE_SIZE;
+  tile_count = tile_count_x * tile_count_y;
+
+  int offset_alignment = 0;
+  glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+  std::size_t alignment = std::max(offset_alignment, 1);
+  tile_occupancy_stride = (tile_count * sizeof(unsigned int) + alignment - 1) / alignment * alignment;
+
+  std::vector<unsigned int> occupied(3 * tile_occupancy_stride / sizeof(unsigned int), 1);
+  glCreateBuffers(1, &tile_occupancy_ssbo);
+  glNamedBufferData(tile_occupancy_ssbo, 3 * tile_occupancy_stride, occupied.data(), GL_DYNAMIC_COPY);
+
+  // The indirect dispatch arguments, { active tile count, 1, 1 }, followed by the active tiles.
+  std::vector<unsigned int> active_tiles(3 + tile_count, 0);
+  active_tiles[1] = active_tiles[2] = 1;
+  glCreateBuffers(1, &active_tiles_ssbo);
+  glNamedBufferData(active_tiles_ssbo, active_tiles.size() * sizeof(unsigned int), active_tiles.data(), GL_DYNAMIC_COPY);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, active_tiles_ssbo);
+
+  auto compute_shader_source = Shader::load_source_from_file("shaders/active_tiles.comp");
+  active_tiles_shader = std::make_unique<ComputeShaderProgram>(compute_shader_source, program_cache.get());
+}
+
+// Binds the occupied tiles of this step's trail map, where deposits are marked, the ones the
+// diffusion writes and the stale ones.
+void Application::bind_tile_occupancy() const {
+  std::size_t size = tile_count * sizeof(unsigned int);
+  for (unsigned int i = 0; i < 3; ++i) {
+    std::size_t offset = (step_count + i) % 3 * tile_occupancy_stride;
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 8 + i, tile_occupancy_ssbo, offset, size);
+  }
+}
+
+void Application::dispatch_active_tiles_shader() const {
+  unsigned int zero = 0;
+  glClearNamedBufferSubData(active_tiles_ssbo, GL_R32UI, 0, sizeof(unsigned int), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+  active_tiles_shader->use();
+  static unsigned int local_group_size = active_tiles_shader->local_group_size().x;
+  glDispatchCompute((tile_count + local_group_size - 1) / local_group_size, 1, 1);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
 }
 
 void Application::update_title() {
@@ -1,23 +1,53 @@
 #pragma once
+#include "application_config.h"
 #include "shader_util.h"
+#include "cpu_engine.h"
+#include "gpu_profiler.h"
+#include "frame_recorder.h"
+#include "checkpoint.h"
+#include <glm/vec2.hpp>
 #include <memory>
 #include <array>
+#include <optional>
+#include <thread>
+#include <vector>
+#include <cstddef>
 
 struct GLFWwindow;
 
-struct ApplicationConfig {
-  unsigned int window_x, window_y;
-  bool fullscreen;
-
-  unsigned int sim_res_x, sim_res_y;
+// Mirrors the std140 SimulationParams block of shaders/simulation_params.glsl.
+struct SimulationParams {
+  glm::ivec2 resolution;
   unsigned int agent_count;
-
-  float agent_speed, turn_speed;
-  float diffuse_rate, evaporate_rate;
-
+  float agent_speed;
+  float turn_speed;
   float sensor_span;
   float sensor_range;
   int sensor_size;
+  float diffuse_rate;
+  float evaporate_rate;
+  float dt;
+  unsigned int seed;
+  float deposit_amount;
+};
+static_assert(sizeof(SimulationParams) == 52);
+
+// Throughput of a headless run. Per-pass timings come from the CPU engine, or from the GPU
+// profiler when profile_gpu is set, and are averaged over the passes' invocations.
+struct RunStats {
+  struct PassTiming {
+    const char* name;
+    std::size_t sample_count;
+    double mean_ms;
+  };
+
+  Backend backend;
+  // The CPU engine's kernels, see CpuEngine::cpu_kernels_name; "none" on the GPU.
+  const char* cpu_kernels;
+  int frame_count;
+  unsigned int step_count;
+  double seconds;
+  std::vector<PassTiming> passes;
 };
 
 class Application {
@@ -32,38 +62,116 @@ public:
 
   void run();
 
+  // Valid after run() returned from a headless run.
+  const RunStats& run_stats() const;
+
+  // False when the GPU backend was asked for but no GL context could be made, so the
+  // application fell back to the CPU.
+  bool has_gpu_context() const;
+
 private:
   ApplicationConfig config;
 
-  GLFWwindow* window;
+  GLFWwindow* window = nullptr;
   void init_context();
 
+  void* egl_display = nullptr;
+  void* egl_context = nullptr;
+  bool init_headless_context();
+
+  bool has_gl_context = false;
+  std::unique_ptr<ProgramCache> program_cache;
+
   bool to_render_ui = false;
   void init_imgui();
   void render_ui();
 
-  unsigned int screen_quad_vao, screen_quad_vbo, scree_quad_ebo;
+  unsigned int screen_quad_vao = 0, screen_quad_vbo = 0, scree_quad_ebo = 0;
   std::unique_ptr<GraphicsShaderProgram> screen_quad_shader;
   void init_screen_quad();
   void init_screen_quad_shader();
   void render_screen_quad() const;
 
-  std::array<unsigned int, 2> screen_textures;
+  // The simulation ping-pongs between the two textures; current_screen_texture holds the latest trail map.
+  std::array<unsigned int, 2> screen_textures {};
+  unsigned int current_screen_texture = 0;
   void init_screen_textures();
 
-  unsigned int agents_ssbo;
+  unsigned int simulation_params_ubo = 0;
+  std::optional<SimulationParams> uploaded_params;
+  void init_simulation_params_ubo();
+  void upload_simulation_params();
+
+  unsigned int agent_positions_ssbo = 0, agent_headings_ssbo = 0, agent_ids_ssbo = 0;
   std::unique_ptr<ComputeShaderProgram> agents_update_shader;
-  void init_agents_ssbo();
+  void init_agents_ssbos();
   void init_agents_update_shader();
   void dispatch_agents_update_shader() const;
 
+  std::unique_ptr<ComputeShaderProgram> agents_deposit_shader;
+  void init_agents_deposit_shader();
+  void dispatch_agents_deposit_shader() const;
+
+  SortGrid sort_grid;
+  unsigned int sorted_positions_ssbo = 0, sorted_headings_ssbo = 0, sorted_ids_ssbo = 0;
+  unsigned int sort_bins_ssbo = 0, sort_keys_ssbo = 0;
+  std::unique_ptr<ComputeShaderProgram> agents_sort_histogram_shader;
+  std::unique_ptr<ComputeShaderProgram> agents_sort_scan_shader;
+  std::unique_ptr<ComputeShaderProgram> agents_sort_scatter_shader;
+  void init_agents_sort();
+  void dispatch_agents_sort_shaders();
+
+  std::array<unsigned int, 2> deposit_textures {};
+  void init_deposit_textures();
+
   std::unique_ptr<ComputeShaderProgram> screen_update_shader;
   void init_screen_update_shader();
   void dispatch_screen_update_shader() const;
 
+  // Three sets of tile flags take turns as the occupied tiles of the current trail map, the ones
+  // being written and the stale ones, each tile_occupancy_stride bytes into tile_occupancy_ssbo.
+  unsigned int tile_occupancy_ssbo = 0, active_tiles_ssbo = 0;
+  unsigned int tile_count = 0;
+  std::size_t tile_occupancy_stride = 0;
+  std::unique_ptr<ComputeShaderProgram> active_tiles_shader;
+  void init_sparse_tiles();
+  void bind_tile_occupancy() const;
+  void dispatch_active_tiles_shader() const;
+
+  std::unique_ptr<CpuEngine> cpu_engine;
+  void upload_cpu_trail_map() const;
+
+  std::unique_ptr<GpuProfiler> gpu_profiler;
+
+  std::unique_ptr<FrameRecorder> frame_recorder;
+  void record_frame();
+
+  // GPU checkpoints are copied into a staging buffer and mapped once its fence has signalled;
+  // the file is written on checkpoint_writer.
+  struct PendingCheckpoint {
+    CheckpointHeader header;
+    unsigned int staging_buffer;
+    void* fence;
+  };
+  std::optional<PendingCheckpoint> pending_checkpoint;
+  std::thread checkpoint_writer;
+  void update_checkpoints();
+  void save_checkpoint();
+  void collect_checkpoint(bool wait);
+  void write_checkpoint_async(std::vector<std::byte>);
+  void restore_checkpoint(const CheckpointFile&);
+
+  void update_simulation();
+  void step_simulation();
+  void run_headless();
+  RunStats last_run_stats {};
+
   void update_title();
   void process_input();
 
   float delta_time;
   int frame_count = 0;
+
+  float step_delta_time;
+  unsigned int step_count = 0;
 };
\ No newline at end of file
@@ -0,0 +1,120 @@
+#pragma once
+#include <string>
+
+enum class Backend {
+  gpu,
+  cpu,
+};
+
+// Storage of the trail map. The single-channel formats keep only the trail luminance and
+// are shown in grey, which cuts the memory traffic of the sense and diffuse passes.
+enum class TrailFormat {
+  rgba32f,
+  r32f,
+  r16f,
+  r8,
+};
+
+enum class RecordFormat {
+  y4m,
+  png,
+};
+
+// How agents landing on the same texel combine. Overwrite sets the texel to 1, accumulate adds
+// deposit_amount per agent, so fewer agents reach the same trail density.
+enum class DepositMode {
+  overwrite,
+  accumulate,
+};
+
+struct ApplicationConfig {
+  unsigned int window_x, window_y;
+  bool fullscreen;
+
+  unsigned int sim_res_x, sim_res_y;
+  unsigned int agent_count;
+
+  float agent_speed, turn_speed;
+  float diffuse_rate, evaporate_rate;
+
+  float sensor_span;
+  float sensor_range;
+  int sensor_size;
+
+  TrailFormat trail_format;
+  bool tiled_diffusion;
+
+  // GPU only: agents mark deposits in a one byte mask that the tiled diffusion pass applies, so a
+  // step reads and writes the trail map once. Implies tiled_diffusion.
+  bool fused_pipeline;
+
+  // Only the tiles of the trail map holding trail or a deposit, and the tiles around them, are
+  // diffused, so a step costs what the mould covers rather than the whole map. The GPU lists the
+  // active tiles every step and diffuses them with an indirect dispatch, which implies
+  // tiled_diffusion; the CPU skips the inactive tiles of every band. Assumes evaporate_rate >= 0,
+  // which keeps empty tiles at zero.
+  bool sparse_tiles;
+
+  // Accumulating deposits are counted with integer atomics on the GPU, which implies
+  // fused_pipeline, and per thread on the CPU, so the result doesn't depend on agent order.
+  DepositMode deposit_mode;
+  float deposit_amount;
+
+  // Agents are re-sorted into spatial order every sort_interval steps; 0 disables sorting.
+  unsigned int sort_interval;
+
+  // Deterministic runs derive everything from `seed`, step at a fixed dt and keep deposits from
+  // racing with sensing, so the same config reproduces the same trail map bit for bit.
+  // Otherwise the seed is drawn at startup.
+  bool deterministic;
+  unsigned int seed;
+
+  Backend backend;
+  unsigned int thread_count;
+
+  // Pins the CPU backend's threads to NUMA nodes, places every band of trail map rows in the
+  // memory of the node whose threads update it, and keeps one list of agents per node, into
+  // which agents that cross to another node's bands are moved every sort_interval steps.
+  bool numa_placement;
+
+  // More than one splits a headless CPU run into bands of rows stepped by that many processes on
+  // this machine (see distributed.h).
+  unsigned int process_count;
+
+  // The CPU backend updates agents and the trail map with the widest vector kernels the CPU
+  // supports, except in deterministic runs, which keep to the scalar code so every machine
+  // computes the same result.
+  bool simd_kernels;
+
+  // Headless runs step the simulation frame_limit times without a window, UI or vsync.
+  // A frame_limit of 0 means the windowed mode runs until it is closed.
+  bool headless;
+  unsigned int frame_limit;
+
+  // Every displayed frame runs `substeps` simulation steps of fixed_dt seconds each.
+  // A fixed_dt of 0 splits the measured frame time between the substeps instead.
+  float fixed_dt;
+  unsigned int substeps;
+
+  // Times every GPU pass; samples are also written to profile_csv_path unless it is empty.
+  bool profile_gpu;
+  std::string profile_csv_path;
+
+  // Every frame is recorded to record_path unless it is empty; see FrameRecorder.
+  std::string record_path;
+  RecordFormat record_format;
+
+  // Every checkpoint_interval frames, and when the run ends, the full simulation state is saved to
+  // checkpoint_path; an interval of 0 only saves at the end. A run started with a restore_path
+  // continues from that checkpoint, with the simulation parameters it was saved with.
+  std::string checkpoint_path;
+  unsigned int checkpoint_interval;
+  std::string restore_path;
+
+  // A sweep such as "agent_speed=0.05,0.1;turn_speed=5,10" runs one simulation for every
+  // combination of the listed values, side by side on the CPU, for frame_limit frames.
+  std::string sweep;
+
+  // Linked program binaries are cached here between runs; empty disables the cache.
+  std::string program_cache_dir;
+};
\ No newline at end of file
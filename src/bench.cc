@@ -0,0 +1,223 @@
+#include "application.h"
+#include "bench_commit.h"
+#include <glad/glad.h>
+#include <fmt/core.h>
+#include <exception>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifndef BENCH_GIT_COMMIT
+#define BENCH_GIT_COMMIT "unknown"
+#endif
+
+#define BENCH_DEFAULT_FRAMES 100
+
+namespace {
+
+struct Scenario {
+  std::string name;
+  ApplicationConfig config;
+};
+
+// The baseline is spelled out here rather than taken from main.cc, so changing the interactive
+// defaults doesn't change what the benchmark measures. The CPU engine only uses its vector kernels
+// outside deterministic runs, so CPU scenarios aren't deterministic and draw their seed at startup.
+ApplicationConfig baseline_config(Backend backend, unsigned int frame_count) {
+  return {
+    .window_x = 1920,
+    .window_y = 1080,
+    .fullscreen = false,
+    .sim_res_x = 1920,
+    .sim_res_y = 1080,
+    .agent_count = 1'000'000,
+    .agent_speed = 0.1,
+    .turn_speed = 10.0,
+    .diffuse_rate = 75.0,
+    .evaporate_rate = 1.0,
+    .sensor_span = 15.0,
+    .sensor_range = 0.025,
+    .sensor_size = 1,
+    .trail_format = TrailFormat::rgba32f,
+    .tiled_diffusion = true,
+    .fused_pipeline = true,
+    .sparse_tiles = false,
+    .deposit_mode = DepositMode::overwrite,
+    .deposit_amount = 0.25,
+    .sort_interval = 64,
+    .deterministic = (backend == Backend::gpu),
+    .seed = 1,
+    .backend = backend,
+    .thread_count = 0,
+    .numa_placement = false,
+    .process_count = 1,
+    .simd_kernels = true,
+    .headless = true,
+    .frame_limit = frame_count,
+    .fixed_dt = 0.0,
+    .substeps = 1,
+    .profile_gpu = (backend == Backend::gpu),
+    .profile_csv_path = "",
+    .record_path = "",
+    .record_format = RecordFormat::y4m,
+    .checkpoint_path = "",
+    .checkpoint_interval = 0,
+    .restore_path = "",
+    .sweep = "",
+    .program_cache_dir = "shader_cache",
+  };
+}
+
+// Every axis is varied on its own around the baseline of 1M agents at 1080p with a sensor size of 1.
+std::vector<Scenario> make_scenarios(unsigned int frame_count) {
+  struct Resolution {
+    const char* name;
+    unsigned int x, y;
+  };
+
+  std::vector<Scenario> scenarios;
+  for (Backend backend : { Backend::gpu, Backend::cpu }) {
+    std::string backend_name = (backend == Backend::gpu ? "gpu" : "cpu");
+
+    for (unsigned int agent_count : { 100'000u, 1'000'000u, 10'000'000u }) {
+      auto config = baseline_config(backend, frame_count);
+      config.agent_count = agent_count;
+      scenarios.push_back({ fmt::format("{}/agents_{}k", backend_name, agent_count / 1000), config });
+    }
+
+    for (auto [name, x, y] : { Resolution { "4k", 3840, 2160 }, Resolution { "8k", 7680, 4320 } }) {
+      auto config = baseline_config(backend, frame_count);
+      config.sim_res_x = x, config.sim_res_y = y;
+      scenarios.push_back({ fmt::format("{}/resolution_{}", backend_name, name), config });
+    }
+
+    for (int sensor_size : { 0, 2, 3 }) {
+      auto config = baseline_config(backend, frame_count);
+      config.sensor_size = sensor_size;
+      scenarios.push_back({ fmt::format("{}/sensor_size_{}", backend_name, sensor_size), config });
+    }
+  }
+
+  return scenarios;
+}
+
+std::string json_string(std::string_view text) {
+  std::string escaped = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') escaped += '\\';
+    if (static_cast<unsigned char>(c) < 0x20) {
+      escaped += fmt::format("\\u{:04x}", c);
+      continue;
+    }
+    escaped += c;
+  }
+  return escaped + "\"";
+}
+
+}
+
+// Runs the scenarios whose name contains the filter and writes their results to a JSON file.
+// Usage: bench [--frames <count>] [--filter <text>] [--output <path>]
+int main(int argc, char** argv) {
+  unsigned int frame_count = BENCH_DEFAULT_FRAMES;
+  std::string filter;
+  std::string output_path = "bench.json";
+
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string_view arg = argv[i];
+      if (i + 1 >= argc) {
+        throw std::runtime_error(fmt::format("Missing value for '{}'.", arg));
+      }
+      if (arg == "--frames") {
+        frame_count = std::stoul(argv[++i]);
+      } else if (arg == "--filter") {
+        filter = argv[++i];
+      } else if (arg == "--output") {
+        output_path = argv[++i];
+      } else {
+        throw std::runtime_error(fmt::format("Unknown argument '{}'.", arg));
+      }
+    }
+
+    std::vector<std::string> results;
+    std::string renderer = "none";
+    for (const auto& [name, config] : make_scenarios(frame_count)) {
+      if (name.find(filter) == std::string::npos) continue;
+      fmt::println("{}", name);
+
+      // A GPU scenario without a GL context falls back to the CPU and measures nothing useful.
+      // GL functions aren't loaded then, so the renderer is only read with a context.
+      Application app { config };
+      if (config.backend == Backend::gpu) {
+        if (!app.has_gpu_context()) {
+          fmt::println("  skipped, no GPU context");
+          continue;
+        }
+        const char* gl_renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+        renderer = (gl_renderer != nullptr ? gl_renderer : "unknown");
+      }
+      app.run();
+      const auto& stats = app.run_stats();
+
+      std::string passes;
+      for (const auto& [pass_name, sample_count, mean_ms] : stats.passes) {
+        passes += fmt::format(
+          "{}\n        {{ \"name\": {}, \"samples\": {}, \"mean_ms\": {:.4f} }}",
+          (passes.empty() ? "" : ","), json_string(pass_name), sample_count, mean_ms
+        );
+      }
+
+      double steps_per_second = stats.step_count / stats.seconds;
+      results.push_back(fmt::format(
+        "    {{\n"
+        "      \"name\": {},\n"
+        "      \"agent_count\": {},\n"
+        "      \"resolution\": [{}, {}],\n"
+        "      \"sensor_size\": {},\n"
+        "      \"cpu_kernels\": {},\n"
+        "      \"frames\": {},\n"
+        "      \"steps\": {},\n"
+        "      \"seconds\": {:.6f},\n"
+        "      \"steps_per_second\": {:.3f},\n"
+        "      \"agent_steps_per_second\": {:.1f},\n"
+        "      \"passes\": [{}\n      ]\n"
+        "    }}",
+        json_string(name), config.agent_count, config.sim_res_x, config.sim_res_y, config.sensor_size,
+        json_string(stats.cpu_kernels),
+        stats.frame_count, stats.step_count, stats.seconds, steps_per_second,
+        steps_per_second * config.agent_count, passes
+      ));
+    }
+
+    std::string scenarios;
+    for (const auto& result : results) {
+      scenarios += (scenarios.empty() ? "\n" : ",\n") + result;
+    }
+
+    std::ofstream file { output_path };
+    file << fmt::format(
+      "{{\n"
+      "  \"commit\": {},\n"
+      "  \"gl_renderer\": {},\n"
+      "  \"hardware_threads\": {},\n"
+      "  \"frames\": {},\n"
+      "  \"scenarios\": [{}\n  ]\n"
+      "}}\n",
+      json_string(BENCH_GIT_COMMIT), json_string(renderer), std::thread::hardware_concurrency(),
+      frame_count, scenarios
+    );
+    if (!file) {
+      throw std::runtime_error(fmt::format("Failed to write '{}'.", output_path));
+    }
+    fmt::println("Wrote {} results to {}", results.size(), output_path);
+
+  } catch (const std::exception& e) {
+    fmt::println("Exception occured: {}", e.what());
+    return 1;
+  }
+
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+# Writes the commit being built to OUTPUT as BENCH_GIT_COMMIT. Runs on every build, and only
+# rewrites OUTPUT when the commit changed, so bench is recompiled only then.
+set(content "")
+if (GIT_EXECUTABLE)
+  execute_process(
+    COMMAND ${GIT_EXECUTABLE} rev-parse --short HEAD
+    WORKING_DIRECTORY ${SOURCE_DIR}
+    OUTPUT_VARIABLE commit
+    OUTPUT_STRIP_TRAILING_WHITESPACE
+    RESULT_VARIABLE result
+    ERROR_QUIET
+  )
+  if (result EQUAL 0 AND commit)
+    set(content "#define BENCH_GIT_COMMIT \"${commit}\"\n")
+  endif()
+endif()
+
+if (EXISTS ${OUTPUT})
+  file(READ ${OUTPUT} previous_content)
+  if (content STREQUAL previous_content)
+    return()
+  endif()
+endif()
+file(WRITE ${OUTPUT} "${content}")
\ No newline at end of file
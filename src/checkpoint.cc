@@ -0,0 +1,203 @@
+#include "checkpoint.h"
+#include <fmt/core.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define HAS_MMAP 0
+#else
+#define HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define CHECKPOINT_MAGIC "MOULDCKP"
+
+namespace {
+
+std::uint64_t align_offset(std::uint64_t offset) {
+  return (offset + checkpoint_alignment - 1) / checkpoint_alignment * checkpoint_alignment;
+}
+
+}
+
+CheckpointHeader make_checkpoint_header(const ApplicationConfig& config, unsigned int trail_channels) {
+  CheckpointHeader header {};
+  std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+  header.version = CHECKPOINT_VERSION;
+  header.header_size = sizeof(CheckpointHeader);
+
+  header.sim_res_x = config.sim_res_x;
+  header.sim_res_y = config.sim_res_y;
+  header.agent_count = config.agent_count;
+  header.trail_channels = trail_channels;
+
+  header.agent_speed = config.agent_speed;
+  header.turn_speed = config.turn_speed;
+  header.diffuse_rate = config.diffuse_rate;
+  header.evaporate_rate = config.evaporate_rate;
+  header.sensor_span = config.sensor_span;
+  header.sensor_range = config.sensor_range;
+  header.sensor_size = config.sensor_size;
+
+  header.deposit_mode = static_cast<std::uint32_t>(config.deposit_mode);
+  header.deposit_amount = config.deposit_amount;
+  header.fused_pipeline = config.fused_pipeline;
+  header.sort_interval = config.sort_interval;
+  header.fixed_dt = config.fixed_dt;
+  header.substeps = config.substeps;
+
+  header.deterministic = config.deterministic;
+  header.seed = config.seed;
+
+  std::uint64_t agent_count = config.agent_count;
+  std::uint64_t texel_count = static_cast<std::uint64_t>(config.sim_res_x) * config.sim_res_y;
+  header.positions_offset = align_offset(sizeof(CheckpointHeader));
+  header.headings_offset = align_offset(header.positions_offset + agent_count * sizeof(glm::vec2));
+  header.ids_offset = align_offset(header.headings_offset + agent_count * sizeof(float));
+  header.trail_offset = align_offset(header.ids_offset + agent_count * sizeof(unsigned int));
+  header.file_size = header.trail_offset + texel_count * trail_channels * sizeof(float);
+  return header;
+}
+
+void write_checkpoint(const std::string& path, const std::vector<std::byte>& data) {
+  std::random_device dev;
+  std::string temp_path = fmt::format("{}.{:08x}.tmp", path, dev());
+  {
+    std::ofstream file { temp_path, std::ios::binary };
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    if (!file) {
+      throw std::runtime_error(fmt::format("Failed to write checkpoint '{}'.", temp_path));
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temp_path, path, error);
+  if (error) {
+    std::filesystem::remove(temp_path, error);
+    throw std::runtime_error(fmt::format("Failed to move checkpoint into place at '{}'.", path));
+  }
+}
+
+CheckpointFile::CheckpointFile(const std::string& path) {
+#if HAS_MMAP
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error(fmt::format("Failed to open checkpoint '{}'.", path));
+  }
+
+  struct stat status;
+  void* mapping = MAP_FAILED;
+  if (fstat(fd, &status) == 0 && status.st_size > 0) {
+    size = status.st_size;
+    mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+
+  if (mapping == MAP_FAILED) {
+    throw std::runtime_error(fmt::format("Failed to map checkpoint '{}'.", path));
+  }
+  data = static_cast<const std::byte*>(mapping);
+#else
+  std::ifstream file { path, std::ios::binary | std::ios::ate };
+  if (!file) {
+    throw std::runtime_error(fmt::format("Failed to open checkpoint '{}'.", path));
+  }
+  buffer.resize(file.tellg());
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+  data = buffer.data(), size = buffer.size();
+#endif
+
+  // The destructor doesn't run when the constructor throws, so validation failures unmap here.
+  auto fail = [&](const char* reason) {
+#if HAS_MMAP
+    munmap(const_cast<std::byte*>(data), size);
+#endif
+    throw std::runtime_error(fmt::format("Checkpoint '{}' {}.", path, reason));
+  };
+
+  if (size < sizeof(CheckpointHeader) || std::memcmp(header().magic, CHECKPOINT_MAGIC, sizeof(header().magic)) != 0) {
+    fail("is not a checkpoint");
+  }
+  if (header().version != CHECKPOINT_VERSION || header().header_size != sizeof(CheckpointHeader)) {
+    fail(fmt::format("has version {}, expected {}", header().version, CHECKPOINT_VERSION).c_str());
+  }
+
+  ApplicationConfig layout_config {};
+  layout_config.sim_res_x = header().sim_res_x;
+  layout_config.sim_res_y = header().sim_res_y;
+  layout_config.agent_count = header().agent_count;
+  auto layout = make_checkpoint_header(layout_config, header().trail_channels);
+  bool has_valid_layout =
+    layout.positions_offset == header().positions_offset && layout.headings_offset == header().headings_offset &&
+    layout.ids_offset == header().ids_offset && layout.trail_offset == header().trail_offset &&
+    layout.file_size == header().file_size && header().file_size <= size;
+  bool has_valid_values = (header().trail_channels == 1 || header().trail_channels == 4) &&
+    header().deposit_mode <= static_cast<std::uint32_t>(DepositMode::accumulate);
+  if (!has_valid_layout || !has_valid_values) {
+    fail("is truncated or corrupt");
+  }
+}
+
+CheckpointFile::~CheckpointFile() {
+#if HAS_MMAP
+  munmap(const_cast<std::byte*>(data), size);
+#endif
+}
+
+const CheckpointHeader& CheckpointFile::header() const {
+  return *reinterpret_cast<const CheckpointHeader*>(data);
+}
+
+const glm::vec2* CheckpointFile::positions() const {
+  return reinterpret_cast<const glm::vec2*>(data + header().positions_offset);
+}
+
+const float* CheckpointFile::headings() const {
+  return reinterpret_cast<const float*>(data + header().headings_offset);
+}
+
+const unsigned int* CheckpointFile::ids() const {
+  return reinterpret_cast<const unsigned int*>(data + header().ids_offset);
+}
+
+const float* CheckpointFile::trail_map() const {
+  return reinterpret_cast<const float*>(data + header().trail_offset);
+}
+
+void CheckpointFile::apply_to(ApplicationConfig& config) const {
+  const auto& h = header();
+  config.sim_res_x = h.sim_res_x, config.sim_res_y = h.sim_res_y;
+  config.agent_count = h.agent_count;
+  config.agent_speed = h.agent_speed, config.turn_speed = h.turn_speed;
+  config.diffuse_rate = h.diffuse_rate, config.evaporate_rate = h.evaporate_rate;
+  config.sensor_span = h.sensor_span, config.sensor_range = h.sensor_range;
+  config.sensor_size = h.sensor_size;
+  config.deposit_mode = static_cast<DepositMode>(h.deposit_mode);
+  config.deposit_amount = h.deposit_amount;
+  config.fused_pipeline = h.fused_pipeline;
+  config.sort_interval = h.sort_interval;
+  config.fixed_dt = h.fixed_dt, config.substeps = h.substeps;
+  config.deterministic = h.deterministic;
+  config.seed = h.seed;
+}
+
+std::vector<float> CheckpointFile::convert_trail_map(unsigned int channel_count) const {
+  std::size_t texel_count = static_cast<std::size_t>(header().sim_res_x) * header().sim_res_y;
+  unsigned int stored_channel_count = header().trail_channels;
+  const float* trail = trail_map();
+
+  std::vector<float> converted(texel_count * channel_count, 1.0f);
+  for (std::size_t i = 0; i < texel_count; ++i) {
+    float value = trail[i * stored_channel_count];
+    std::fill_n(&converted[i * channel_count], std::min(channel_count, 3u), value);
+  }
+  return converted;
+}
\ No newline at end of file
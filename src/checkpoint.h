@@ -0,0 +1,79 @@
+#pragma once
+#include "application_config.h"
+#include <glm/vec2.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define CHECKPOINT_VERSION 2
+
+// A checkpoint is this header followed by the agent positions, headings and ids and the trail map,
+// each at an offset aligned to checkpoint_alignment, so a mapped file can be uploaded section by
+// section without copying. All values are stored in the byte order of the machine that wrote them.
+struct CheckpointHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t header_size;
+
+  std::uint32_t sim_res_x, sim_res_y;
+  std::uint32_t agent_count;
+  std::uint32_t trail_channels;
+
+  float agent_speed, turn_speed;
+  float diffuse_rate, evaporate_rate;
+  float sensor_span, sensor_range;
+  std::int32_t sensor_size;
+
+  // Whatever changes the result of a step, so a resumed run continues like the saved one.
+  std::uint32_t deposit_mode;
+  float deposit_amount;
+  std::uint32_t fused_pipeline;
+  std::uint32_t sort_interval;
+  float fixed_dt;
+  std::uint32_t substeps;
+
+  std::uint32_t deterministic;
+  std::uint32_t seed;
+  std::uint32_t frame_count, step_count;
+
+  std::uint64_t positions_offset, headings_offset, ids_offset, trail_offset;
+  std::uint64_t file_size;
+};
+
+constexpr std::size_t checkpoint_alignment = 4096;
+
+// Fills in the magic, the simulation parameters of the config and the section offsets.
+CheckpointHeader make_checkpoint_header(const ApplicationConfig&, unsigned int trail_channels);
+
+// Writes to a temporary file that is renamed into place, so a run killed mid-write keeps its
+// previous checkpoint. `data` holds the whole file, header included.
+void write_checkpoint(const std::string& path, const std::vector<std::byte>& data);
+
+// A read-only view of a checkpoint, memory mapped where the platform allows it.
+class CheckpointFile {
+public:
+  CheckpointFile(const std::string& path);
+  ~CheckpointFile();
+
+  CheckpointFile(const CheckpointFile&) = delete;
+  CheckpointFile& operator=(const CheckpointFile&) = delete;
+
+  const CheckpointHeader& header() const;
+  const glm::vec2* positions() const;
+  const float* headings() const;
+  const unsigned int* ids() const;
+  const float* trail_map() const;
+
+  // Overrides the simulation parameters of the config with the ones the checkpoint was saved with.
+  void apply_to(ApplicationConfig&) const;
+
+  // The trail map with `channel_count` channels per texel. Grey single-channel maps expand to
+  // opaque RGBA, multi-channel maps keep their first channel.
+  std::vector<float> convert_trail_map(unsigned int channel_count) const;
+
+private:
+  const std::byte* data = nullptr;
+  std::size_t size = 0;
+  std::vector<std::byte> buffer;
+};
\ No newline at end of file
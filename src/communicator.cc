@@ -0,0 +1,205 @@
+#include "communicator.h"
+#include <fmt/core.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+
+void run_local_ranks(int, const std::function<void(Communicator&)>&) {
+  throw std::runtime_error("Distributed runs need POSIX processes and sockets.");
+}
+
+#else
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// Every message is its size as a 64-bit integer followed by its bytes.
+struct Transfer {
+  std::uint64_t header;
+  std::span<const std::byte> payload;
+  std::size_t done = 0;
+
+  std::size_t size() const { return sizeof(header) + payload.size(); }
+
+  // Writes what the socket takes without blocking; false once the socket is closed.
+  bool write_some(int socket) {
+    const std::byte* data = (done < sizeof(header) ? reinterpret_cast<const std::byte*>(&header) + done : payload.data() + (done - sizeof(header)));
+    std::size_t length = (done < sizeof(header) ? sizeof(header) - done : size() - done);
+    ssize_t written = ::send(socket, data, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (written < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    done += written;
+    return true;
+  }
+};
+
+struct Reception {
+  std::uint64_t header = 0;
+  std::vector<std::byte> payload;
+  std::size_t done = 0;
+
+  bool complete() const { return done >= sizeof(header) && done == sizeof(header) + payload.size(); }
+
+  bool read_some(int socket) {
+    std::byte* data = (done < sizeof(header) ? reinterpret_cast<std::byte*>(&header) + done : payload.data() + (done - sizeof(header)));
+    std::size_t length = (done < sizeof(header) ? sizeof(header) - done : sizeof(header) + payload.size() - done);
+    ssize_t received = ::recv(socket, data, length, MSG_DONTWAIT);
+    if (received == 0) return false;
+    if (received < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+    done += received;
+    if (done == sizeof(header)) {
+      payload.resize(header);
+    }
+    return true;
+  }
+};
+
+class LocalCommunicator : public Communicator {
+public:
+  // sockets[r] connects to rank r; the entry of the rank itself is unused.
+  LocalCommunicator(int rank, std::vector<int> sockets) : local_rank { rank }, sockets { std::move(sockets) } {}
+
+  ~LocalCommunicator() override {
+    for (int socket : sockets) {
+      if (socket >= 0) close(socket);
+    }
+  }
+
+  LocalCommunicator(const LocalCommunicator&) = delete;
+  LocalCommunicator& operator=(const LocalCommunicator&) = delete;
+
+  int rank() const override { return local_rank; }
+  int size() const override { return sockets.size(); }
+
+  void send(int destination, std::span<const std::byte> data) override {
+    send_receive(destination, data, no_rank);
+  }
+
+  std::vector<std::byte> receive(int source) override {
+    return send_receive(no_rank, {}, source);
+  }
+
+  std::vector<std::byte> send_receive(int destination, std::span<const std::byte> data, int source) override {
+    Transfer transfer { data.size(), data };
+    Reception reception;
+    bool sending = (destination != no_rank), receiving = (source != no_rank);
+
+    while (sending || receiving) {
+      pollfd fds[2];
+      nfds_t fd_count = 0;
+      if (sending) fds[fd_count++] = { sockets[destination], POLLOUT, 0 };
+      if (receiving) fds[fd_count++] = { sockets[source], POLLIN, 0 };
+      if (poll(fds, fd_count, -1) < 0 && errno != EINTR) {
+        throw std::runtime_error(fmt::format("Rank {} failed to poll its sockets: {}.", local_rank, std::strerror(errno)));
+      }
+
+      if (sending && !transfer.write_some(sockets[destination])) {
+        throw std::runtime_error(fmt::format("Rank {} lost its connection to rank {}.", local_rank, destination));
+      }
+      sending = sending && transfer.done < transfer.size();
+
+      if (receiving && !reception.read_some(sockets[source])) {
+        throw std::runtime_error(fmt::format("Rank {} lost its connection to rank {}.", local_rank, source));
+      }
+      receiving = receiving && !reception.complete();
+    }
+
+    return std::move(reception.payload);
+  }
+
+private:
+  int local_rank;
+  std::vector<int> sockets;
+};
+
+}
+
+void run_local_ranks(int process_count, const std::function<void(Communicator&)>& fn) {
+  // sockets[a][b] is the end rank a holds of the connection between a and b.
+  std::vector<std::vector<int>> sockets(process_count, std::vector<int>(process_count, -1));
+  for (int a = 0; a < process_count; ++a) {
+    for (int b = a + 1; b < process_count; ++b) {
+      int pair[2];
+      if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        throw std::runtime_error(fmt::format("Failed to connect ranks {} and {}: {}.", a, b, std::strerror(errno)));
+      }
+      sockets[a][b] = pair[0], sockets[b][a] = pair[1];
+    }
+  }
+
+  // Every rank closes the ends belonging to the others, so a rank that dies is seen as a closed
+  // connection rather than waited on forever.
+  auto keep_only = [&](int rank) {
+    for (int other = 0; other < process_count; ++other) {
+      if (other == rank) continue;
+      for (int socket : sockets[other]) {
+        if (socket >= 0) close(socket);
+      }
+    }
+  };
+
+  std::fflush(stdout);
+  std::vector<pid_t> children;
+  for (int rank = 1; rank < process_count; ++rank) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      keep_only(0);
+      for (int socket : sockets[0]) {
+        if (socket >= 0) close(socket);
+      }
+      for (pid_t child : children) {
+        waitpid(child, nullptr, 0);
+      }
+      throw std::runtime_error(fmt::format("Failed to start rank {}: {}.", rank, std::strerror(errno)));
+    }
+
+    if (pid == 0) {
+      keep_only(rank);
+      int status = 0;
+      try {
+        LocalCommunicator communicator { rank, sockets[rank] };
+        fn(communicator);
+      } catch (const std::exception& e) {
+        fmt::println(stderr, "Rank {}: {}", rank, e.what());
+        status = 1;
+      }
+      std::fflush(stdout);
+      _exit(status);
+    }
+    children.push_back(pid);
+  }
+
+  keep_only(0);
+  std::string error;
+  try {
+    LocalCommunicator communicator { 0, sockets[0] };
+    fn(communicator);
+  } catch (const std::exception& e) {
+    error = e.what();
+  }
+
+  int failed_count = 0;
+  for (pid_t child : children) {
+    int status = 0;
+    waitpid(child, &status, 0);
+    failed_count += !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+
+  if (!error.empty()) {
+    throw std::runtime_error(error);
+  }
+  if (failed_count != 0) {
+    throw std::runtime_error(fmt::format("{} of {} ranks failed.", failed_count, process_count));
+  }
+}
+
+#endif
\ No newline at end of file
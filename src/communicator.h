@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <functional>
+#include <cstddef>
+
+// Like MPI_PROC_NULL: sending to it or receiving from it does nothing.
+constexpr int no_rank = -1;
+
+// The messaging a distributed run needs, shaped after MPI so that an MPI_Comm can stand behind it
+// to span machines: send is MPI_Send, receive is MPI_Probe followed by MPI_Recv of the probed size,
+// and send_receive is MPI_Sendrecv. Messages between two ranks arrive in the order they were sent.
+class Communicator {
+public:
+  virtual ~Communicator() = default;
+
+  virtual int rank() const = 0;
+  virtual int size() const = 0;
+
+  virtual void send(int destination, std::span<const std::byte>) = 0;
+  virtual std::vector<std::byte> receive(int source) = 0;
+  // Sends to one rank while receiving from another, so ranks that send to each other at the same
+  // time don't wait on each other.
+  virtual std::vector<std::byte> send_receive(int destination, std::span<const std::byte>, int source) = 0;
+};
+
+// Runs fn as every rank of a communicator of `process_count` processes on this machine, connected
+// pairwise by Unix domain sockets. The calling process is rank 0 and the others are forked from
+// it, so this has to be called before any threads are started. Throws once every rank has finished
+// if any of them failed.
+void run_local_ranks(int process_count, const std::function<void(Communicator&)>&);
\ No newline at end of file
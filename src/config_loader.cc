@@ -0,0 +1,227 @@
+#include "config_loader.h"
+#include <fmt/core.h>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace {
+
+template <typename T>
+struct EnumNames;
+
+template <>
+struct EnumNames<Backend> {
+  static constexpr std::array<std::pair<std::string_view, Backend>, 2> names { {
+    { "gpu", Backend::gpu },
+    { "cpu", Backend::cpu },
+  } };
+};
+
+template <>
+struct EnumNames<TrailFormat> {
+  static constexpr std::array<std::pair<std::string_view, TrailFormat>, 4> names { {
+    { "rgba32f", TrailFormat::rgba32f },
+    { "r32f", TrailFormat::r32f },
+    { "r16f", TrailFormat::r16f },
+    { "r8", TrailFormat::r8 },
+  } };
+};
+
+template <>
+struct EnumNames<DepositMode> {
+  static constexpr std::array<std::pair<std::string_view, DepositMode>, 2> names { {
+    { "overwrite", DepositMode::overwrite },
+    { "accumulate", DepositMode::accumulate },
+  } };
+};
+
+template <>
+struct EnumNames<RecordFormat> {
+  static constexpr std::array<std::pair<std::string_view, RecordFormat>, 2> names { {
+    { "y4m", RecordFormat::y4m },
+    { "png", RecordFormat::png },
+  } };
+};
+
+[[noreturn]] void invalid_value(std::string_view key, std::string_view value) {
+  throw std::runtime_error(fmt::format("Invalid value '{}' for config key '{}'.", value, key));
+}
+
+template <typename T>
+T parse_value(std::string_view key, std::string_view value) {
+  if constexpr (std::is_same_v<T, bool>) {
+    if (value == "true" || value == "1") return true;
+    if (value == "false" || value == "0") return false;
+    invalid_value(key, value);
+  } else if constexpr (std::is_same_v<T, std::string>) {
+    return std::string { value };
+  } else if constexpr (std::is_enum_v<T>) {
+    for (auto [name, enum_value] : EnumNames<T>::names) {
+      if (name == value) return enum_value;
+    }
+    invalid_value(key, value);
+  } else {
+    // Negative numbers would wrap around in unsigned fields rather than fail to parse.
+    if (std::is_unsigned_v<T> && value.starts_with('-')) {
+      invalid_value(key, value);
+    }
+    T result {};
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (error != std::errc {} || end != value.data() + value.size()) {
+      invalid_value(key, value);
+    }
+    return result;
+  }
+}
+
+struct ConfigOption {
+  std::string_view key;
+  bool is_flag;
+  void (*set)(ApplicationConfig&, std::string_view key, std::string_view value);
+};
+
+template <auto member>
+constexpr ConfigOption option(std::string_view key) {
+  using T = std::remove_reference_t<decltype(std::declval<ApplicationConfig&>().*member)>;
+  return { key, std::is_same_v<T, bool>, [](ApplicationConfig& config, std::string_view key, std::string_view value) {
+    config.*member = parse_value<T>(key, value);
+  } };
+}
+
+constexpr std::array config_options {
+  option<&ApplicationConfig::window_x>("window_x"),
+  option<&ApplicationConfig::window_y>("window_y"),
+  option<&ApplicationConfig::fullscreen>("fullscreen"),
+  option<&ApplicationConfig::sim_res_x>("sim_res_x"),
+  option<&ApplicationConfig::sim_res_y>("sim_res_y"),
+  option<&ApplicationConfig::agent_count>("agent_count"),
+  option<&ApplicationConfig::agent_speed>("agent_speed"),
+  option<&ApplicationConfig::turn_speed>("turn_speed"),
+  option<&ApplicationConfig::diffuse_rate>("diffuse_rate"),
+  option<&ApplicationConfig::evaporate_rate>("evaporate_rate"),
+  option<&ApplicationConfig::sensor_span>("sensor_span"),
+  option<&ApplicationConfig::sensor_range>("sensor_range"),
+  option<&ApplicationConfig::sensor_size>("sensor_size"),
+  option<&ApplicationConfig::trail_format>("trail_format"),
+  option<&ApplicationConfig::tiled_diffusion>("tiled_diffusion"),
+  option<&ApplicationConfig::fused_pipeline>("fused_pipeline"),
+  option<&ApplicationConfig::sparse_tiles>("sparse_tiles"),
+  option<&ApplicationConfig::deposit_mode>("deposit_mode"),
+  option<&ApplicationConfig::deposit_amount>("deposit_amount"),
+  option<&ApplicationConfig::sort_interval>("sort_interval"),
+  option<&ApplicationConfig::deterministic>("deterministic"),
+  option<&ApplicationConfig::seed>("seed"),
+  option<&ApplicationConfig::backend>("backend"),
+  option<&ApplicationConfig::thread_count>("thread_count"),
+  option<&ApplicationConfig::numa_placement>("numa_placement"),
+  option<&ApplicationConfig::process_count>("process_count"),
+  option<&ApplicationConfig::simd_kernels>("simd_kernels"),
+  option<&ApplicationConfig::headless>("headless"),
+  option<&ApplicationConfig::frame_limit>("frame_limit"),
+  option<&ApplicationConfig::fixed_dt>("fixed_dt"),
+  option<&ApplicationConfig::substeps>("substeps"),
+  option<&ApplicationConfig::profile_gpu>("profile_gpu"),
+  option<&ApplicationConfig::profile_csv_path>("profile_csv_path"),
+  option<&ApplicationConfig::record_path>("record_path"),
+  option<&ApplicationConfig::record_format>("record_format"),
+  option<&ApplicationConfig::checkpoint_path>("checkpoint_path"),
+  option<&ApplicationConfig::checkpoint_interval>("checkpoint_interval"),
+  option<&ApplicationConfig::restore_path>("restore_path"),
+  option<&ApplicationConfig::sweep>("sweep"),
+  option<&ApplicationConfig::program_cache_dir>("program_cache_dir"),
+};
+
+const ConfigOption& find_option(std::string_view key) {
+  auto it = std::find_if(config_options.begin(), config_options.end(), [&](const auto& option) {
+    return option.key == key;
+  });
+  if (it == config_options.end()) {
+    throw std::runtime_error(fmt::format("Unknown config key '{}'.", key));
+  }
+  return *it;
+}
+
+std::string_view trim(std::string_view text) {
+  std::size_t begin = text.find_first_not_of(" \t\r");
+  if (begin == std::string_view::npos) return {};
+  std::size_t end = text.find_last_not_of(" \t\r");
+  return text.substr(begin, end - begin + 1);
+}
+
+}
+
+void load_config_file(ApplicationConfig& config, const std::string& path) {
+  std::ifstream file { path };
+  if (!file) {
+    throw std::runtime_error(fmt::format("Failed to open config file '{}'.", path));
+  }
+
+  std::string line;
+  for (int line_number = 1; std::getline(file, line); ++line_number) {
+    std::string_view text = trim(line);
+    if (text.empty() || text.starts_with('#')) continue;
+
+    std::size_t equals = text.find('=');
+    if (equals == std::string_view::npos) {
+      throw std::runtime_error(fmt::format("{}:{}: expected 'key = value'.", path, line_number));
+    }
+
+    std::string_view key = trim(text.substr(0, equals));
+    std::string_view value = trim(text.substr(equals + 1));
+    if (value.size() >= 2 && value.starts_with('"') && value.ends_with('"')) {
+      value = value.substr(1, value.size() - 2);
+    }
+
+    try {
+      set_config_value(config, key, value);
+    } catch (const std::runtime_error& e) {
+      throw std::runtime_error(fmt::format("{}:{}: {}", path, line_number, e.what()));
+    }
+  }
+}
+
+void set_config_value(ApplicationConfig& config, std::string_view key, std::string_view value) {
+  find_option(key).set(config, key, value);
+}
+
+bool parse_command_line(ApplicationConfig& config, int argc, char** argv) {
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (!arg.starts_with("--")) {
+      throw std::runtime_error(fmt::format("Unexpected argument '{}'.", arg));
+    }
+    arg.remove_prefix(2);
+
+    if (arg == "help") {
+      fmt::println("Usage: {} [--config <file>] [--<key>=<value>...]\nKeys:", argv[0]);
+      for (const auto& option : config_options) {
+        fmt::println("  {}", option.key);
+      }
+      return false;
+    }
+
+    std::string_view key = arg, value;
+    std::size_t equals = arg.find('=');
+    if (equals != std::string_view::npos) {
+      key = arg.substr(0, equals), value = arg.substr(equals + 1);
+    } else if (key != "config" && find_option(key).is_flag) {
+      value = "true";
+    } else if (i + 1 < argc) {
+      value = argv[++i];
+    } else {
+      throw std::runtime_error(fmt::format("Missing value for '--{}'.", key));
+    }
+
+    if (key == "config") {
+      load_config_file(config, std::string { value });
+    } else {
+      set_config_value(config, key, value);
+    }
+  }
+
+  return true;
+}
\ No newline at end of file
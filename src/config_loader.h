@@ -0,0 +1,17 @@
+#pragma once
+#include "application_config.h"
+#include <string>
+#include <string_view>
+
+// Every ApplicationConfig field can be set by its name, from a file of `key = value` lines or from
+// `--key=value` arguments. Unknown keys and malformed values throw std::runtime_error.
+
+// Blank lines and lines starting with '#' are skipped. Values may be quoted.
+void load_config_file(ApplicationConfig&, const std::string& path);
+
+void set_config_value(ApplicationConfig&, std::string_view key, std::string_view value);
+
+// Applies the arguments in order: `--config <path>` loads a file, `--key=value` or `--key value`
+// sets a field, and a bare `--flag` sets a bool field to true.
+// Returns false when `--help` was given, after printing the available keys.
+bool parse_command_line(ApplicationConfig&, int argc, char** argv);
\ No newline at end of file
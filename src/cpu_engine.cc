@@ -0,0 +1,648 @@
+#include "cpu_engine.h"
+#include "numa.h"
+#include "random.h"
+#include <glm/ext/scalar_constants.hpp>
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace {
+
+constexpr std::size_t agent_chunk_size = 4096;
+constexpr std::size_t band_row_count = 16;
+constexpr std::size_t tile_column_count = 128;
+
+}
+
+CpuEngine::CpuEngine(const ApplicationConfig& config, std::optional<RowDomain> domain)
+  : res_x { config.sim_res_x },
+    res_y { config.sim_res_y },
+    window_begin { 0 },
+    window_end { config.sim_res_y },
+    owned_begin { 0 },
+    owned_end { config.sim_res_y },
+    numa_placement { config.numa_placement },
+    thread_pool { config.thread_count, config.numa_placement },
+    sparse_tiles { config.sparse_tiles } {
+  agents = generate_agents(config.agent_count, config.seed);
+
+  // Every engine of a distributed run generates the same agents and keeps the ones on its rows.
+  if (domain) {
+    owned_begin = domain->owned_begin, owned_end = domain->owned_end;
+    window_begin = owned_begin - std::min(owned_begin, domain->halo_rows);
+    window_end = std::min(owned_end + domain->halo_rows, res_y);
+    exchange = domain->exchange;
+
+    Agents owned_agents;
+    for (std::size_t id = 0; id < agents.size(); ++id) {
+      unsigned int row = agent_row(agents.positions[id]);
+      if (row >= owned_begin && row < owned_end) {
+        owned_agents.positions.push_back(agents.positions[id]);
+        owned_agents.headings.push_back(agents.headings[id]);
+        owned_agents.ids.push_back(agents.ids[id]);
+      }
+    }
+    agents = std::move(owned_agents);
+  }
+
+  node_agent_offsets = { 0, static_cast<unsigned int>(agents.size()) };
+  sort_grid = make_sort_grid(res_x, res_y);
+  kernels = (config.simd_kernels && !config.deterministic ? select_cpu_kernels() : scalar_cpu_kernels());
+  deposits.resize(agents.size());
+  std::size_t texel_count = static_cast<std::size_t>(res_x) * (window_end - window_begin);
+  if (config.deposit_mode == DepositMode::accumulate) {
+    deposit_counts.assign(texel_count, 0);
+  }
+  for (auto& trail_map : trail_maps) {
+    trail_map.assign(texel_count, 0.0f);
+  }
+
+  // Bands go to the threads in contiguous runs, so the bands of a node are contiguous too.
+  std::size_t band_count = (window_end - window_begin + band_row_count - 1) / band_row_count;
+  std::size_t thread_count = thread_pool.size();
+  band_row_sums.resize(band_count);
+  for (std::size_t band = 0; band < band_count; ++band) {
+    std::size_t thread = band * thread_count / band_count;
+    band_threads.push_back(numa_placement ? thread : TaskGraph::any_thread);
+    band_nodes.push_back(thread_pool.thread_node(thread));
+  }
+
+  // Every tile counts as occupied until the first step has found out which are.
+  if (sparse_tiles) {
+    band_tile_count = (res_x + tile_column_count - 1) / tile_column_count;
+    for (auto& occupied : occupied_tiles) {
+      occupied.assign(band_count * band_tile_count, 1);
+    }
+    stale_tiles.assign(band_count * band_tile_count, 1);
+  }
+
+  if (numa_placement) {
+    node_threads.resize(thread_pool.node_count());
+    for (std::size_t thread = 0; thread < thread_count; ++thread) {
+      node_threads[thread_pool.thread_node(thread)].push_back(thread);
+    }
+    place_memory();
+  } else {
+    for (auto& row_sums : band_row_sums) {
+      row_sums.resize(4 * static_cast<std::size_t>(res_x), 0.0f);
+    }
+  }
+}
+
+// Pages are allocated on the node of the thread that touches them first. Every thread touches the
+// rows of the bands it owns and an even share of the agent arrays, after the pages written so far
+// by the thread creating the engine are released.
+void CpuEngine::place_memory() {
+  std::size_t width = res_x;
+  auto release = [](auto& values) { release_pages(values.data(), values.size() * sizeof(values[0])); };
+  auto touch_rows = [&](auto& values, std::size_t band) {
+    std::size_t begin = band * band_row_count * width;
+    std::size_t end = std::min<std::size_t>(begin + band_row_count * width, values.size());
+    std::fill(values.begin() + begin, values.begin() + end, 0);
+  };
+
+  for (auto& trail_map : trail_maps) {
+    release(trail_map);
+  }
+  release(deposit_counts);
+  thread_pool.for_each_thread([&](std::size_t thread) {
+    for (std::size_t band = 0; band < band_threads.size(); ++band) {
+      if (band_threads[band] != thread) continue;
+      for (auto& trail_map : trail_maps) {
+        touch_rows(trail_map, band);
+      }
+      if (!deposit_counts.empty()) {
+        touch_rows(deposit_counts, band);
+      }
+      band_row_sums[band].assign(4 * width, 0.0f);
+    }
+  });
+
+  // The agents move into their nodes' lists on the first sort, which copies them into
+  // sorted_agents; the buffer they were generated in is placed after that.
+  auto touch_agents = [&](Agents& target) {
+    target.positions.resize(agents.size());
+    target.headings.resize(agents.size());
+    target.ids.resize(agents.size());
+    release(target.positions), release(target.headings), release(target.ids), release(deposits);
+
+    std::size_t agent_count = agents.size(), thread_count = thread_pool.size();
+    thread_pool.for_each_thread([&](std::size_t thread) {
+      std::size_t begin = thread * agent_count / thread_count, end = (thread + 1) * agent_count / thread_count;
+      std::fill(target.positions.begin() + begin, target.positions.begin() + end, glm::vec2 { 0.0f });
+      std::fill(target.headings.begin() + begin, target.headings.begin() + end, 0.0f);
+      std::fill(target.ids.begin() + begin, target.ids.begin() + end, 0u);
+      std::fill(deposits.begin() + begin, deposits.begin() + end, 0u);
+    });
+  };
+
+  touch_agents(sorted_agents);
+  sort_agents();
+  touch_agents(sorted_agents);
+}
+
+void CpuEngine::add_pass_time(CpuPass pass, std::chrono::steady_clock::duration elapsed) {
+  auto& time = pass_times[static_cast<std::size_t>(pass)];
+  ++time.count;
+  time.seconds += std::chrono::duration<double>(elapsed).count();
+}
+
+// Everything after the sort runs as one task graph:
+//
+//   agent chunks -> agents_updated -> deposits of every band -> trail map update of every band
+//
+// Agents sense anywhere on the trail map, so no deposit may land before the last of them is done,
+// but the trail map update of a band only waits for the deposits into it and the bands next to it.
+// Deposits and the trail map update overlap, so the time of both counts towards screen_update.
+void CpuEngine::step(const ApplicationConfig& config, float dt) {
+  ++step_count;
+  if (config.sort_interval != 0 && step_count % config.sort_interval == 0) {
+    auto start_time = std::chrono::steady_clock::now();
+    sort_agents();
+    add_pass_time(CpuPass::agents_sort, std::chrono::steady_clock::now() - start_time);
+  }
+
+  // Agents are updated in chunks of their node's list, each placed on a thread of that node.
+  struct AgentChunk {
+    std::size_t begin, end, thread;
+  };
+
+  std::vector<AgentChunk> chunks;
+  for (std::size_t node = 0; node + 1 < node_agent_offsets.size(); ++node) {
+    std::size_t node_begin = node_agent_offsets[node], node_end = node_agent_offsets[node + 1];
+    for (std::size_t begin = node_begin; begin < node_end; begin += agent_chunk_size) {
+      std::size_t thread = TaskGraph::any_thread;
+      if (numa_placement) {
+        const auto& threads = node_threads[node];
+        thread = threads[(begin - node_begin) / agent_chunk_size % threads.size()];
+      }
+      chunks.push_back({ begin, std::min(begin + agent_chunk_size, node_end), thread });
+    }
+  }
+
+  // Agents that arrive from other engines deposit through one more set of bins.
+  std::size_t chunk_count = chunks.size();
+  std::size_t band_count = band_row_sums.size();
+  deposit_bins.resize((chunk_count + 1) * band_count);
+
+  auto start_time = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point agents_time;
+
+  step_graph.clear();
+  auto agents_updated = step_graph.add([&] {
+    if (exchange != nullptr) {
+      migrate_agents(chunk_count);
+    }
+    agents_time = std::chrono::steady_clock::now();
+  });
+  for (std::size_t chunk = 0; chunk < chunk_count; ++chunk) {
+    auto [begin, end, thread] = chunks[chunk];
+    auto update = step_graph.add([&, chunk, begin, end] {
+      update_agents(config, dt, begin, end);
+      bin_deposits(chunk, begin, end);
+    }, thread);
+    step_graph.depend(agents_updated, update);
+  }
+
+  std::vector<TaskGraph::Task> deposit_tasks(band_count);
+  for (std::size_t band = 0; band < band_count; ++band) {
+    deposit_tasks[band] = step_graph.add([&, band] { apply_deposits(config, band); }, band_threads[band]);
+    step_graph.depend(deposit_tasks[band], agents_updated);
+  }
+
+  // The halos are traded once the owned rows along the borders have their deposits, and only the
+  // bands diffusing across a border wait for them.
+  std::optional<TaskGraph::Task> halos_exchanged;
+  if (exchange != nullptr) {
+    halos_exchanged = step_graph.add([&] { exchange->exchange_halos(trail_maps[0]); });
+    std::size_t halo_rows = std::max(owned_begin - window_begin, window_end - owned_end);
+    for (std::size_t band = 0; band < band_count; ++band) {
+      std::size_t band_begin = window_begin + band * band_row_count, band_end = band_begin + band_row_count;
+      bool sends_rows = band_begin < owned_begin + halo_rows || band_end > owned_end - std::min<std::size_t>(halo_rows, owned_end);
+      if (sends_rows) {
+        step_graph.depend(*halos_exchanged, deposit_tasks[band]);
+      }
+    }
+  }
+
+  for (std::size_t band = 0; band < band_count; ++band) {
+    auto update = step_graph.add([&, band] { update_trail_band(config, dt, band); }, band_threads[band]);
+    for (std::size_t neighbour = (band > 0 ? band - 1 : 0); neighbour <= std::min(band + 1, band_count - 1); ++neighbour) {
+      step_graph.depend(update, deposit_tasks[neighbour]);
+    }
+
+    // A band reads one row past either end.
+    std::size_t band_begin = window_begin + band * band_row_count, band_end = band_begin + band_row_count;
+    if (halos_exchanged && (band_begin <= owned_begin || band_end >= owned_end)) {
+      step_graph.depend(update, *halos_exchanged);
+    }
+  }
+
+  thread_pool.run(step_graph);
+  std::swap(trail_maps[0], trail_maps[1]);
+  if (sparse_tiles) {
+    std::swap(stale_tiles, occupied_tiles[0]);
+    std::swap(occupied_tiles[0], occupied_tiles[1]);
+  }
+
+  add_pass_time(CpuPass::agents_update, agents_time - start_time);
+  add_pass_time(CpuPass::screen_update, std::chrono::steady_clock::now() - agents_time);
+}
+
+const std::vector<float>& CpuEngine::trail_map() const {
+  return trail_maps[0];
+}
+
+unsigned int CpuEngine::first_row() const {
+  return window_begin;
+}
+
+const Agents& CpuEngine::current_agents() const {
+  return agents;
+}
+
+CpuEngine::PassTime CpuEngine::pass_time(CpuPass pass) const {
+  return pass_times[static_cast<std::size_t>(pass)];
+}
+
+const char* CpuEngine::cpu_kernels_name() const {
+  return kernels.name;
+}
+
+const char* CpuEngine::pass_name(CpuPass pass) {
+  switch (pass) {
+    case CpuPass::agents_sort: return "agents_sort";
+    case CpuPass::agents_update: return "agents_update";
+    case CpuPass::screen_update: return "screen_update";
+  }
+  return "unknown";
+}
+
+// Copies into the existing buffers, which keeps their pages on the nodes they were placed on.
+void CpuEngine::restore(const Agents& _agents, const std::vector<float>& trail_map, unsigned int _step_count) {
+  agents = _agents;
+  trail_maps[0] = trail_map;
+  step_count = _step_count;
+  for (auto& occupied : occupied_tiles) {
+    std::fill(occupied.begin(), occupied.end(), 1);
+  }
+  std::fill(stale_tiles.begin(), stale_tiles.end(), 1);
+
+  node_agent_offsets = { 0, static_cast<unsigned int>(agents.size()) };
+  if (numa_placement) {
+    sort_agents();
+  }
+}
+
+// Agents on the bottom edge, at y = 1, belong to the last row.
+unsigned int CpuEngine::agent_row(glm::vec2 position) const {
+  return std::min(static_cast<unsigned int>(position.y * res_y), res_y - 1);
+}
+
+// Agents keep their order, so every node's list stays contiguous; the agents that arrive join the
+// last list until the next sort. Their deposits are binned like those of a chunk of agents.
+void CpuEngine::migrate_agents(std::size_t arrival_chunk) {
+  Agents leaving;
+  std::size_t kept_count = 0;
+  std::vector<unsigned int> offsets = node_agent_offsets;
+  for (std::size_t node = 0; node + 1 < offsets.size(); ++node) {
+    node_agent_offsets[node] = kept_count;
+    for (std::size_t id = offsets[node]; id < offsets[node + 1]; ++id) {
+      unsigned int row = agent_row(agents.positions[id]);
+      if (row >= owned_begin && row < owned_end) {
+        agents.positions[kept_count] = agents.positions[id];
+        agents.headings[kept_count] = agents.headings[id];
+        agents.ids[kept_count] = agents.ids[id];
+        ++kept_count;
+      } else {
+        leaving.positions.push_back(agents.positions[id]);
+        leaving.headings.push_back(agents.headings[id]);
+        leaving.ids.push_back(agents.ids[id]);
+      }
+    }
+  }
+
+  Agents arrived = exchange->migrate_agents(leaving);
+  agents.positions.resize(kept_count), agents.headings.resize(kept_count), agents.ids.resize(kept_count);
+  agents.positions.insert(agents.positions.end(), arrived.positions.begin(), arrived.positions.end());
+  agents.headings.insert(agents.headings.end(), arrived.headings.begin(), arrived.headings.end());
+  agents.ids.insert(agents.ids.end(), arrived.ids.begin(), arrived.ids.end());
+  node_agent_offsets.back() = agents.size();
+  deposits.resize(agents.size());
+
+  for (std::size_t id = kept_count; id < agents.size(); ++id) {
+    glm::ivec2 texel_coord = glm::ivec2(agents.positions[id] * glm::vec2(res_x, res_y));
+    bool in_bounds = texel_coord.x < static_cast<int>(res_x) && texel_coord.y < static_cast<int>(res_y);
+    deposits[id] = (in_bounds ? texel_coord.y * res_x + texel_coord.x : no_deposit);
+  }
+  bin_deposits(arrival_chunk, kept_count, agents.size());
+}
+
+// A stable counting sort: every thread counts the keys of one contiguous range of agents, and the
+// per-range counts are turned into offsets bin by bin, so agents keep their order within a bin.
+// Agents are sorted by the node owning their band first, which splits them into one list per node
+// and moves the ones that crossed into another node's bands over to that node's list.
+void CpuEngine::sort_agents() {
+  std::size_t agent_count = agents.size();
+  std::size_t range_count = thread_pool.size();
+  std::size_t range_size = (agent_count + range_count - 1) / range_count;
+  std::size_t node_count = (numa_placement ? thread_pool.node_count() : 1);
+  unsigned int cell_count = sort_grid.bin_count();
+  unsigned int bin_count = cell_count * static_cast<unsigned int>(node_count);
+  glm::uvec2 resolution { res_x, res_y };
+
+  auto sort_key = [&](glm::vec2 position) {
+    unsigned int row = agent_row(position) - window_begin;
+    return static_cast<unsigned int>(band_nodes[row / band_row_count]) * cell_count + morton_key(position, resolution, sort_grid);
+  };
+
+  sort_keys.resize(agent_count);
+  sort_offsets.assign(range_count * bin_count, 0);
+  thread_pool.parallel_for(agent_count, range_size, [&](std::size_t begin, std::size_t end) {
+    unsigned int* counts = &sort_offsets[begin / range_size * bin_count];
+    for (std::size_t id = begin; id < end; ++id) {
+      sort_keys[id] = sort_key(agents.positions[id]);
+      ++counts[sort_keys[id]];
+    }
+  });
+
+  unsigned int offset = 0;
+  node_agent_offsets.resize(node_count + 1);
+  for (unsigned int bin = 0; bin < bin_count; ++bin) {
+    if (bin % cell_count == 0) {
+      node_agent_offsets[bin / cell_count] = offset;
+    }
+    for (std::size_t range = 0; range < range_count; ++range) {
+      unsigned int& count = sort_offsets[range * bin_count + bin];
+      unsigned int range_offset = offset;
+      offset += count;
+      count = range_offset;
+    }
+  }
+  node_agent_offsets[node_count] = offset;
+
+  sorted_agents.positions.resize(agent_count);
+  sorted_agents.headings.resize(agent_count);
+  sorted_agents.ids.resize(agent_count);
+  thread_pool.parallel_for(agent_count, range_size, [&](std::size_t begin, std::size_t end) {
+    unsigned int* offsets = &sort_offsets[begin / range_size * bin_count];
+    for (std::size_t id = begin; id < end; ++id) {
+      unsigned int sorted_id = offsets[sort_keys[id]]++;
+      sorted_agents.positions[sorted_id] = agents.positions[id];
+      sorted_agents.headings[sorted_id] = agents.headings[id];
+      sorted_agents.ids[sorted_id] = agents.ids[id];
+    }
+  });
+
+  std::swap(agents, sorted_agents);
+}
+
+float CpuEngine::sense(const ApplicationConfig& config, glm::vec2 center, float angle) const {
+  glm::vec2 dir = glm::vec2(glm::cos(angle), glm::sin(angle));
+  center += dir * config.sensor_range;
+
+  const auto& input = trail_maps[0];
+  glm::ivec2 base = glm::ivec2(center * glm::vec2(res_x, res_y));
+  int size = config.sensor_size;
+
+  float sum = 0;
+  for (int dx = -size; dx <= size; ++dx) {
+    for (int dy = -size; dy <= size; ++dy) {
+      int x = base.x + dx, y = base.y + dy;
+      if (x >= 0 && x < static_cast<int>(res_x) && y >= static_cast<int>(window_begin) && y < static_cast<int>(window_end)) {
+        sum += input[static_cast<std::size_t>(y - window_begin) * res_x + x];
+      }
+    }
+  }
+
+  return sum;
+}
+
+void CpuEngine::update_agents(const ApplicationConfig& config, float dt, std::size_t begin, std::size_t end) {
+  float sensor_span = glm::radians(config.sensor_span);
+
+  AgentKernelParams kernel_params {
+    .res_x = res_x,
+    .res_y = res_y,
+    .first_row = window_begin,
+    .end_row = window_end,
+    .agent_speed = config.agent_speed,
+    .turn_speed = config.turn_speed,
+    .sensor_span = sensor_span,
+    .sensor_range = config.sensor_range,
+    .sensor_size = config.sensor_size,
+    .dt = dt,
+    .seed = config.seed,
+    .step_count = step_count,
+  };
+  AgentKernelData kernel_data { agents.positions.data(), agents.headings.data(), deposits.data(), trail_maps[0].data() };
+
+  // The vector kernel leaves the agents that don't fill a vector to the scalar loop.
+  std::size_t first_scalar_id = begin;
+  if (kernels.update_agents != nullptr) {
+    first_scalar_id = kernels.update_agents(kernel_params, kernel_data, begin, end);
+  }
+
+  for (std::size_t id = first_scalar_id; id < end; ++id) {
+    unsigned int agent_id = (config.deterministic ? agents.ids[id] : id);
+    unsigned int rand_state = agent_rand_state(agent_id, step_count, config.seed);
+
+    glm::vec2 pos = agents.positions[id];
+    float angle = agents.headings[id];
+
+    float weight_fwd = sense(config, pos, angle);
+    float weight_ccw = sense(config, pos, angle + sensor_span / 2.0f);
+    float weight_cw = sense(config, pos, angle - sensor_span / 2.0f);
+
+    float rand_steer = rand_float(rand_state);
+    if (weight_fwd > weight_ccw && weight_fwd > weight_cw) {
+      angle += 0.0f;
+    } else if (weight_fwd < weight_ccw && weight_fwd < weight_cw) {
+      angle += 2.0f * (rand_steer - 0.5f) * config.turn_speed * dt;
+    } else if (weight_ccw > weight_cw) {
+      angle += rand_steer * config.turn_speed * dt;
+    } else if (weight_cw > weight_ccw) {
+      angle -= rand_steer * config.turn_speed * dt;
+    }
+
+    glm::vec2 dir = glm::vec2(glm::cos(angle), glm::sin(angle));
+
+    // Reflecting off a wall mirrors the heading, as negating one component of dir would.
+    pos += config.agent_speed * dir * dt;
+    if (pos.x < 0.0f) {
+      pos.x = 0.0f;
+      angle = glm::pi<float>() - angle;
+    }
+
+    if (pos.x > 1.0f) {
+      pos.x = 1.0f;
+      angle = glm::pi<float>() - angle;
+    }
+
+    if (pos.y < 0.0f) {
+      pos.y = 0.0f;
+      angle = -angle;
+    }
+
+    if (pos.y > 1.0f) {
+      pos.y = 1.0f;
+      angle = -angle;
+    }
+
+    glm::ivec2 texel_coord = glm::ivec2(pos * glm::vec2(res_x, res_y));
+    bool in_bounds = texel_coord.x < static_cast<int>(res_x) && texel_coord.y < static_cast<int>(res_y);
+    deposits[id] = (in_bounds ? texel_coord.y * res_x + texel_coord.x : no_deposit);
+
+    agents.positions[id] = pos, agents.headings[id] = wrap_heading(angle);
+  }
+}
+
+// Sorts the deposits of one chunk of agents by the band of rows they land in, so the deposits into
+// a band are applied without looking at every agent. Bins hold texels of the kept rows.
+void CpuEngine::bin_deposits(std::size_t chunk, std::size_t begin, std::size_t end) {
+  std::size_t band_count = band_row_sums.size();
+  std::size_t band_size = band_row_count * res_x;
+  auto bins = &deposit_bins[chunk * band_count];
+  for (std::size_t band = 0; band < band_count; ++band) {
+    bins[band].clear();
+  }
+
+  // Agents that left the owned rows deposit with the engine they migrate to.
+  std::size_t owned_texel_begin = static_cast<std::size_t>(owned_begin) * res_x;
+  std::size_t owned_texel_end = static_cast<std::size_t>(owned_end) * res_x;
+  std::size_t first_texel = static_cast<std::size_t>(window_begin) * res_x;
+  for (std::size_t id = begin; id < end; ++id) {
+    if (deposits[id] != no_deposit && deposits[id] >= owned_texel_begin && deposits[id] < owned_texel_end) {
+      unsigned int texel = deposits[id] - first_texel;
+      bins[texel / band_size].push_back(texel);
+    }
+  }
+}
+
+// Every agent has sensed the old trail map by now, so depositing in place is equivalent to the
+// shader writing into a copy of it. Accumulated deposits are counted before they are added, and
+// integer counts add up the same whichever chunk comes first.
+void CpuEngine::apply_deposits(const ApplicationConfig& config, std::size_t band) {
+  std::size_t band_count = band_row_sums.size();
+  std::size_t chunk_count = deposit_bins.size() / band_count;
+  auto& output = trail_maps[0];
+
+  if (sparse_tiles) {
+    unsigned char* occupied = &occupied_tiles[0][band * band_tile_count];
+    for (std::size_t chunk = 0; chunk < chunk_count; ++chunk) {
+      for (unsigned int texel : deposit_bins[chunk * band_count + band]) {
+        occupied[texel % res_x / tile_column_count] = 1;
+      }
+    }
+  }
+
+  if (config.deposit_mode == DepositMode::overwrite) {
+    for (std::size_t chunk = 0; chunk < chunk_count; ++chunk) {
+      for (unsigned int texel : deposit_bins[chunk * band_count + band]) {
+        output[texel] = 1.0f;
+      }
+    }
+    return;
+  }
+
+  for (std::size_t chunk = 0; chunk < chunk_count; ++chunk) {
+    for (unsigned int texel : deposit_bins[chunk * band_count + band]) {
+      ++deposit_counts[texel];
+    }
+  }
+  for (std::size_t chunk = 0; chunk < chunk_count; ++chunk) {
+    for (unsigned int texel : deposit_bins[chunk * band_count + band]) {
+      if (unsigned int count = std::exchange(deposit_counts[texel], 0u); count != 0) {
+        output[texel] += count * config.deposit_amount;
+      }
+    }
+  }
+}
+
+// A tile is diffused when a tile next to it or itself holds trail, since the blur reads one
+// texel across its border, or when trail_maps[1] still holds trail of it from the step before,
+// which has to be overwritten. Every other tile would come out zero and already is. Rows that are
+// traded with other engines count as occupied, since their trail arrives unseen.
+void CpuEngine::update_trail_band(const ApplicationConfig& config, float dt, std::size_t band) {
+  std::size_t width = res_x, height = window_end - window_begin;
+  if (!sparse_tiles) {
+    update_trail_span(config, dt, band, 0, width);
+    return;
+  }
+
+  std::size_t band_count = band_row_sums.size();
+  std::size_t band_begin = window_begin + band * band_row_count;
+  std::size_t band_end = std::min<std::size_t>(band_begin + band_row_count, window_end);
+  bool is_traded = band_begin < owned_begin || band_end > owned_end;
+  const auto& occupied = occupied_tiles[0];
+  auto is_active = [&](std::size_t tile) {
+    if (is_traded || stale_tiles[band * band_tile_count + tile]) return true;
+    for (std::size_t neighbour_band = (band > 0 ? band - 1 : 0); neighbour_band <= std::min(band + 1, band_count - 1); ++neighbour_band) {
+      for (std::size_t neighbour = (tile > 0 ? tile - 1 : 0); neighbour <= std::min(tile + 1, band_tile_count - 1); ++neighbour) {
+        if (occupied[neighbour_band * band_tile_count + neighbour]) return true;
+      }
+    }
+    return false;
+  };
+
+  // Runs of active tiles are diffused as one span, which keeps the rows the kernels see long.
+  const auto& output = trail_maps[1];
+  unsigned char* next_occupied = &occupied_tiles[1][band * band_tile_count];
+  std::size_t row_begin = band * band_row_count, row_end = std::min(row_begin + band_row_count, height);
+  for (std::size_t tile = 0; tile < band_tile_count;) {
+    if (!is_active(tile)) {
+      next_occupied[tile++] = 0;
+      continue;
+    }
+
+    std::size_t first_tile = tile;
+    while (tile < band_tile_count && is_active(tile)) {
+      ++tile;
+    }
+    update_trail_span(config, dt, band, first_tile * tile_column_count, std::min(tile * tile_column_count, width));
+
+    for (std::size_t span_tile = first_tile; span_tile < tile; ++span_tile) {
+      std::size_t begin = span_tile * tile_column_count, end = std::min(begin + tile_column_count, width);
+      bool holds_trail = is_traded;
+      for (std::size_t y = row_begin; y < row_end && !holds_trail; ++y) {
+        holds_trail = std::any_of(&output[y * width + begin], &output[y * width + end], [](float value) { return value != 0.0f; });
+      }
+      next_occupied[span_tile] = holds_trail;
+    }
+  }
+}
+
+// The 3x3 blur is separable: every row is summed horizontally once, and three of those row sums
+// add up to the blur of the row between them. A band is walked top to bottom, keeping the sums of
+// the rows above, at and below the current one in a ring that stays in cache, and only the two
+// rows bordering the band are summed twice. Diffusion and evaporation are applied as each row is
+// stored. Only the columns [begin_x, end_x) are updated, and their sums are taken over one more
+// column on either side, so the sums inside the span match those of the whole row.
+void CpuEngine::update_trail_span(const ApplicationConfig& config, float dt, std::size_t band, std::size_t begin_x, std::size_t end_x) {
+  const auto& input = trail_maps[0];
+  auto& output = trail_maps[1];
+  std::size_t width = res_x, height = window_end - window_begin;
+  float diffuse = config.diffuse_rate * dt, evaporate = config.evaporate_rate * dt;
+
+  // Three ring slots and a row of zeros standing in for the rows past the top and bottom edges.
+  auto& row_sums = band_row_sums[band];
+  const float* zeros = &row_sums[3 * width];
+  auto sums_of = [&](std::size_t y) { return &row_sums[(y % 3) * width]; };
+  std::size_t sum_begin = (begin_x > 0 ? begin_x - 1 : 0), sum_end = std::min(end_x + 1, width);
+  auto sum_row = [&](std::size_t y) { kernels.sum_row(&input[y * width + sum_begin], sums_of(y) + sum_begin, sum_end - sum_begin); };
+
+  std::size_t begin = band * band_row_count, end = std::min(begin + band_row_count, height);
+  if (begin > 0) {
+    sum_row(begin - 1);
+  }
+  sum_row(begin);
+  for (std::size_t y = begin; y < end; ++y) {
+    if (y + 1 < height) {
+      sum_row(y + 1);
+    }
+
+    const float* above = (y > 0 ? sums_of(y - 1) : zeros);
+    const float* below = (y + 1 < height ? sums_of(y + 1) : zeros);
+    kernels.diffuse_row(&input[y * width + begin_x], above + begin_x, sums_of(y) + begin_x, below + begin_x, &output[y * width + begin_x], end_x - begin_x, diffuse, evaporate);
+  }
+}
\ No newline at end of file
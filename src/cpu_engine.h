@@ -0,0 +1,126 @@
+#pragma once
+#include "application_config.h"
+#include "agent.h"
+#include "cpu_kernels.h"
+#include "thread_pool.h"
+#include <glm/glm.hpp>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <optional>
+#include <cstddef>
+
+// Named like the matching GpuPass, so timings compare across backends. The CPU applies deposits
+// while it updates the trail map, so they count towards screen_update and have no pass of their own.
+enum class CpuPass {
+  agents_sort,
+  agents_update,
+  screen_update,
+};
+
+constexpr std::size_t cpu_pass_count = 3;
+
+// How an engine that owns only some rows of the trail map trades with the engines owning the
+// others. Called from one task at a time.
+class RowExchange {
+public:
+  virtual ~RowExchange() = default;
+
+  // Sends off the agents that left the owned rows and returns the ones that entered them.
+  virtual Agents migrate_agents(const Agents& leaving) = 0;
+  // Sends the owned rows along each border to the neighbour across it, and overwrites the halo
+  // rows of `trail_map` with the neighbours' rows in return.
+  virtual void exchange_halos(std::vector<float>& trail_map) = 0;
+};
+
+// The rows [owned_begin, owned_end) one engine of a distributed run updates, with halo_rows rows
+// of its neighbours kept on either side, enough to sense across the border and diffuse the rows
+// that are sensed.
+struct RowDomain {
+  unsigned int owned_begin, owned_end;
+  unsigned int halo_rows;
+  RowExchange* exchange;
+};
+
+// Runs the same step as agents_update.comp and screen_update.comp on the CPU, spread across a thread pool.
+class CpuEngine {
+public:
+  // Without a domain the engine owns the whole trail map.
+  CpuEngine(const ApplicationConfig&, std::optional<RowDomain> = std::nullopt);
+
+  CpuEngine(const CpuEngine&) = delete;
+  CpuEngine& operator=(const CpuEngine&) = delete;
+
+  void step(const ApplicationConfig&, float dt);
+
+  // Single-channel trail luminance, row by row like screen_textures[0], from first_row() on.
+  const std::vector<float>& trail_map() const;
+  unsigned int first_row() const;
+  const Agents& current_agents() const;
+
+  // Continues from a checkpoint taken after `step_count` steps. Only for engines owning the
+  // whole trail map.
+  void restore(const Agents&, const std::vector<float>& trail_map, unsigned int step_count);
+
+  struct PassTime {
+    std::size_t count;
+    double seconds;
+  };
+
+  // Wall time of every pass since the engine was created.
+  PassTime pass_time(CpuPass) const;
+  static const char* pass_name(CpuPass);
+
+  // "scalar" when the agents and trail map are updated without vector kernels.
+  const char* cpu_kernels_name() const;
+
+private:
+  unsigned int res_x, res_y;
+  // Rows [window_begin, window_end) are kept, of which [owned_begin, owned_end) are updated.
+  unsigned int window_begin, window_end;
+  unsigned int owned_begin, owned_end;
+  RowExchange* exchange = nullptr;
+  bool numa_placement;
+  ThreadPool thread_pool;
+  CpuKernels kernels;
+
+  Agents agents, sorted_agents;
+  SortGrid sort_grid;
+  std::vector<unsigned int> sort_keys;
+  std::vector<unsigned int> sort_offsets;
+  // Agents of node n are [node_agent_offsets[n], node_agent_offsets[n + 1]).
+  std::vector<unsigned int> node_agent_offsets;
+  std::vector<std::vector<std::size_t>> node_threads;
+  std::vector<unsigned int> deposits;
+  std::vector<std::vector<unsigned int>> deposit_bins;
+  std::vector<unsigned int> deposit_counts;
+  std::array<std::vector<float>, 2> trail_maps;
+  std::vector<std::vector<float>> band_row_sums;
+  // With sparse_tiles, bands are split into tiles of tile_column_count columns, flagged while
+  // they hold trail: occupied_tiles[0] for trail_maps[0] with this step's deposits,
+  // occupied_tiles[1] for the rows written into trail_maps[1], and stale_tiles for what
+  // trail_maps[1] still holds from the step before.
+  bool sparse_tiles;
+  std::size_t band_tile_count = 1;
+  std::array<std::vector<unsigned char>, 2> occupied_tiles;
+  std::vector<unsigned char> stale_tiles;
+  std::vector<std::size_t> band_threads;
+  std::vector<std::size_t> band_nodes;
+  TaskGraph step_graph;
+
+  unsigned int step_count = 0;
+  std::array<PassTime, cpu_pass_count> pass_times {};
+
+  void add_pass_time(CpuPass, std::chrono::steady_clock::duration);
+
+  void place_memory();
+  unsigned int agent_row(glm::vec2 position) const;
+  void migrate_agents(std::size_t arrival_chunk);
+  void sort_agents();
+  void update_agents(const ApplicationConfig&, float dt, std::size_t begin, std::size_t end);
+  void bin_deposits(std::size_t chunk, std::size_t begin, std::size_t end);
+  void apply_deposits(const ApplicationConfig&, std::size_t band);
+  void update_trail_band(const ApplicationConfig&, float dt, std::size_t band);
+  void update_trail_span(const ApplicationConfig&, float dt, std::size_t band, std::size_t begin_x, std::size_t end_x);
+  float sense(const ApplicationConfig&, glm::vec2 center, float angle) const;
+};
\ No newline at end of file
@@ -0,0 +1,35 @@
+#include "cpu_kernels.h"
+#include <glm/glm.hpp>
+
+void sum_row_scalar(const float* row, float* sums, std::size_t width) {
+  for (std::size_t x = 0; x < width; ++x) {
+    float left = (x > 0 ? row[x - 1] : 0.0f);
+    float right = (x + 1 < width ? row[x + 1] : 0.0f);
+    sums[x] = left + row[x] + right;
+  }
+}
+
+void diffuse_row_scalar(const float* original, const float* above, const float* middle, const float* below, float* output, std::size_t width, float diffuse, float evaporate) {
+  for (std::size_t x = 0; x < width; ++x) {
+    float blur_color = (above[x] + middle[x] + below[x]) / 9.0f;
+    float diffused_color = glm::mix(original[x], blur_color, diffuse);
+    output[x] = glm::max(0.0f, diffused_color - evaporate);
+  }
+}
+
+CpuKernels scalar_cpu_kernels() {
+  return { "scalar", nullptr, sum_row_scalar, diffuse_row_scalar };
+}
+
+CpuKernels select_cpu_kernels() {
+#ifdef HAS_SIMD_CPU_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return { "avx512", update_agents_avx512, sum_row_avx512, diffuse_row_avx512 };
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return { "avx2", update_agents_avx2, sum_row_avx2, diffuse_row_avx2 };
+  }
+#endif
+  return scalar_cpu_kernels();
+}
\ No newline at end of file
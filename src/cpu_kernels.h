@@ -0,0 +1,64 @@
+#pragma once
+#include <glm/vec2.hpp>
+#include <cstddef>
+
+// Marks an agent that left the trail map this step.
+constexpr unsigned int no_deposit = ~0u;
+
+struct AgentKernelParams {
+  unsigned int res_x, res_y;
+  // trail_map holds the rows [first_row, end_row) of the res_x by res_y map.
+  unsigned int first_row, end_row;
+  float agent_speed, turn_speed;
+  float sensor_span, sensor_range;
+  int sensor_size;
+  float dt;
+  unsigned int seed;
+  unsigned int step_count;
+};
+
+struct AgentKernelData {
+  glm::vec2* positions;
+  float* headings;
+  unsigned int* deposits;
+  const float* trail_map;
+};
+
+// Updates agents [begin, end) like the scalar loop of CpuEngine::update_agents, a whole vector
+// of agents at a time, and returns where it stopped because fewer agents were left than fit a
+// vector. Agents draw their random numbers by index, so kernels don't serve deterministic runs,
+// and sin and cos are polynomial approximations, so results differ from the scalar loop in the
+// last bits.
+using AgentKernel = std::size_t (*)(const AgentKernelParams&, const AgentKernelData&, std::size_t begin, std::size_t end);
+
+// Sums every texel of one trail map row with its left and right neighbour, counting texels past
+// either end as zero.
+using RowSumKernel = void (*)(const float* row, float* sums, std::size_t width);
+
+// Finishes one trail map row from the row sums of the rows above, at and below it: the 3x3 blur
+// is mixed into the original by `diffuse`, then `evaporate` is taken off and the result clamped
+// to zero before it is stored, all in one pass over the row.
+using DiffuseRowKernel = void (*)(const float* original, const float* above, const float* middle, const float* below, float* output, std::size_t width, float diffuse, float evaporate);
+
+struct CpuKernels {
+  const char* name;
+  // Null when agents are updated by the scalar loop of CpuEngine::update_agents.
+  AgentKernel update_agents;
+  RowSumKernel sum_row;
+  DiffuseRowKernel diffuse_row;
+};
+
+CpuKernels scalar_cpu_kernels();
+// The widest kernels the CPU supports, found with CPUID; the scalar ones when there are none.
+CpuKernels select_cpu_kernels();
+
+void sum_row_scalar(const float* row, float* sums, std::size_t width);
+void diffuse_row_scalar(const float* original, const float* above, const float* middle, const float* below, float* output, std::size_t width, float diffuse, float evaporate);
+
+std::size_t update_agents_avx2(const AgentKernelParams&, const AgentKernelData&, std::size_t begin, std::size_t end);
+void sum_row_avx2(const float* row, float* sums, std::size_t width);
+void diffuse_row_avx2(const float* original, const float* above, const float* middle, const float* below, float* output, std::size_t width, float diffuse, float evaporate);
+
+std::size_t update_agents_avx512(const AgentKernelParams&, const AgentKernelData&, std::size_t begin, std::size_t end);
+void sum_row_avx512(const float* row, float* sums, std::size_t width);
+void diffuse_row_avx512(const float* original, const float* above, const float* middle, const float* below, float* output, std::size_t width, float diffuse, float evaporate);
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include "cpu_kernels_simd.h"
+#include <immintrin.h>
+
+namespace {
+
+// Eight agents per vector. Masks are vectors of all-ones or all-zeros lanes.
+struct Avx2 {
+  static constexpr std::size_t width = 8;
+  using F = __m256;
+  using I = __m256i;
+  using M = __m256;
+
+  static F set1(float value) { return _mm256_set1_ps(value); }
+  static I set1i(unsigned int value) { return _mm256_set1_epi32(static_cast<int>(value)); }
+  static I iota(unsigned int first) { return _mm256_add_epi32(set1i(first), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)); }
+
+  static F load(const float* source) { return _mm256_loadu_ps(source); }
+  static void store(float* target, F value) { _mm256_storeu_ps(target, value); }
+  static void storei(unsigned int* target, I value) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(target), value); }
+
+  // [x0 y0 x1 y1 x2 y2 x3 y3] [x4 y4 ...] to [x0 ... x7] [y0 ... y7] and back.
+  static void load_xy(const glm::vec2* source, F& x, F& y) {
+    F low = _mm256_loadu_ps(&source[0].x), high = _mm256_loadu_ps(&source[4].x);
+    F even = _mm256_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0));
+    F odd = _mm256_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1));
+    x = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(even), _MM_SHUFFLE(3, 1, 2, 0)));
+    y = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(odd), _MM_SHUFFLE(3, 1, 2, 0)));
+  }
+
+  static void store_xy(glm::vec2* target, F x, F y) {
+    F low = _mm256_unpacklo_ps(x, y), high = _mm256_unpackhi_ps(x, y);
+    _mm256_storeu_ps(&target[0].x, _mm256_permute2f128_ps(low, high, 0x20));
+    _mm256_storeu_ps(&target[4].x, _mm256_permute2f128_ps(low, high, 0x31));
+  }
+
+  static F add(F a, F b) { return _mm256_add_ps(a, b); }
+  static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+  static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+  static F div(F a, F b) { return _mm256_div_ps(a, b); }
+  static F neg(F a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+  static F fmadd(F a, F b, F c) { return _mm256_fmadd_ps(a, b, c); }
+  static F fnmadd(F a, F b, F c) { return _mm256_fnmadd_ps(a, b, c); }
+  static F min(F a, F b) { return _mm256_min_ps(a, b); }
+  static F max(F a, F b) { return _mm256_max_ps(a, b); }
+  static F floor(F a) { return _mm256_floor_ps(a); }
+  static F round(F a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+  static I to_int(F a) { return _mm256_cvttps_epi32(a); }
+  // Converts the halves separately, so only the final addition rounds.
+  static F u32_to_float(I a) {
+    F high = _mm256_cvtepi32_ps(_mm256_srli_epi32(a, 16));
+    F low = _mm256_cvtepi32_ps(_mm256_and_si256(a, _mm256_set1_epi32(0xffff)));
+    return _mm256_fmadd_ps(high, _mm256_set1_ps(65536.0f), low);
+  }
+
+  static M lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static M gt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+  static M lti(I a, I b) { return _mm256_castsi256_ps(_mm256_cmpgt_epi32(b, a)); }
+  static M eqi(I a, I b) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)); }
+  static M mand(M a, M b) { return _mm256_and_ps(a, b); }
+  static M mor(M a, M b) { return _mm256_or_ps(a, b); }
+  static F select(M mask, F a, F b) { return _mm256_blendv_ps(b, a, mask); }
+  static I selecti(M mask, I a, I b) { return _mm256_blendv_epi8(b, a, _mm256_castps_si256(mask)); }
+
+  static I addi(I a, I b) { return _mm256_add_epi32(a, b); }
+  static I subi(I a, I b) { return _mm256_sub_epi32(a, b); }
+  static I muli(I a, I b) { return _mm256_mullo_epi32(a, b); }
+  static I xori(I a, I b) { return _mm256_xor_si256(a, b); }
+  static I andi(I a, I b) { return _mm256_and_si256(a, b); }
+  template <int shift>
+  static I srli(I a) { return _mm256_srli_epi32(a, shift); }
+
+  // Masked-off lanes read nothing and come back as zero.
+  static F gather(const float* base, I index, M mask) {
+    return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), base, index, mask, 4);
+  }
+};
+
+}
+
+std::size_t update_agents_avx2(const AgentKernelParams& params, const AgentKernelData& data, std::size_t begin, std::size_t end) {
+  return simd_update_agents<Avx2>(params, data, begin, end);
+}
+
+void sum_row_avx2(const float* row, float* sums, std::size_t width) {
+  simd_sum_row<Avx2>(row, sums, width);
+}
+
+void diffuse_row_avx2(const float* original, const float* above, const float* middle, const float* below, float* output, std::size_t width, float diffuse, float evaporate) {
+  simd_diffuse_row<Avx2>(original, above, middle, below, output, width, diffuse, evaporate);
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "cpu_kernels_simd.h"
+#include <immintrin.h>
+
+namespace {
+
+// Sixteen agents per vector, with AVX-512F mask registers.
+struct Avx512 {
+  static constexpr std::size_t width = 16;
+  using F = __m512;
+  using I = __m512i;
+  using M = __mmask16;
+
+  static F set1(float value) { return _mm512_set1_ps(value); }
+  static I set1i(unsigned int value) { return _mm512_set1_epi32(static_cast<int>(value)); }
+  static I iota(unsigned int first) {
+    return _mm512_add_epi32(set1i(first), _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+  }
+
+  static F load(const float* source) { return _mm512_loadu_ps(source); }
+  static void store(float* target, F value) { _mm512_storeu_ps(target, value); }
+  static void storei(unsigned int* target, I value) { _mm512_storeu_si512(target, value); }
+
+  static void load_xy(const glm::vec2* source, F& x, F& y) {
+    F low = _mm512_loadu_ps(&source[0].x), high = _mm512_loadu_ps(&source[8].x);
+    I even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+    I odd = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+    x = _mm512_permutex2var_ps(low, even, high);
+    y = _mm512_permutex2var_ps(low, odd, high);
+  }
+
+  static void store_xy(glm::vec2* target, F x, F y) {
+    I low = _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+    I high = _mm512_setr_epi32(8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31);
+    _mm512_storeu_ps(&target[0].x, _mm512_permutex2var_ps(x, low, y));
+    _mm512_storeu_ps(&target[8].x, _mm512_permutex2var_ps(x, high, y));
+  }
+
+  static F add(F a, F b) { return _mm512_add_ps(a, b); }
+  static F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+  static F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+  static F div(F a, F b) { return _mm512_div_ps(a, b); }
+  static F neg(F a) { return _mm512_sub_ps(_mm512_setzero_ps(), a); }
+  static F fmadd(F a, F b, F c) { return _mm512_fmadd_ps(a, b, c); }
+  static F fnmadd(F a, F b, F c) { return _mm512_fnmadd_ps(a, b, c); }
+  static F min(F a, F b) { return _mm512_min_ps(a, b); }
+  static F max(F a, F b) { return _mm512_max_ps(a, b); }
+  static F floor(F a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+  static F round(F a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+  static I to_int(F a) { return _mm512_cvttps_epi32(a); }
+  static F u32_to_float(I a) { return _mm512_cvtepu32_ps(a); }
+
+  static M lt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+  static M gt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+  static M lti(I a, I b) { return _mm512_cmplt_epi32_mask(a, b); }
+  static M eqi(I a, I b) { return _mm512_cmpeq_epi32_mask(a, b); }
+  static M mand(M a, M b) { return a & b; }
+  static M mor(M a, M b) { return a | b; }
+  static F select(M mask, F a, F b) { return _mm512_mask_blend_ps(mask, b, a); }
+  static I selecti(M mask, I a, I b) { return _mm512_mask_blend_epi32(mask, b, a); }
+
+  static I addi(I a, I b) { return _mm512_add_epi32(a, b); }
+  static I subi(I a, I b) { return _mm512_sub_epi32(a, b); }
+  static I muli(I a, I b) { return _mm512_mullo_epi32(a, b); }
+  static I xori(I a, I b) { return _mm512_xor_si512(a, b); }
+  static I andi(I a, I b) { return _mm512_and_si512(a, b); }
+  template <int shift>
+  static I srli(I a) { return _mm512_srli_epi32(a, shift); }
+
+  static F gather(const float* base, I index, M mask) {
+    return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, index, base, 4);
+  }
+};
+
+}
+
+std::size_t update_agents_avx512(const AgentKernelParams& params, const AgentKernelData& data, std::size_t begin, std::size_t end) {
+  return simd_update_agents<Avx512>(params, data, begin, end);
+}
+
+void sum_row_avx512(const float* row, float* sums, std::size_t width) {
+  simd_sum_row<Avx512>(row, sums, width);
+}
+
+void diffuse_row_avx512(const float* original, const float* above, const float* middle, const float* below, float* output, std::size_t width, float diffuse, float evaporate) {
+  simd_diffuse_row<Avx512>(original, above, middle, below, output, width, diffuse, evaporate);
+}
\ No newline at end of file
@@ -0,0 +1,193 @@
+#pragma once
+#include "cpu_kernels.h"
+
+// The agent update and trail map rows written once against a vector type V, which wraps the intrinsics of one
+// instruction set. Only the kernel translation units include this, each compiled for its own
+// instruction set, so everything lives in an anonymous namespace to keep the copies apart.
+namespace {
+
+constexpr float simd_pi = 3.14159265358979f;
+
+// sin and cos after reducing x by the nearest multiple of pi/2 in three parts (Cody-Waite), with
+// the minimax polynomials of Cephes on [-pi/4, pi/4]. Accurate to a few ulp for the headings
+// this sees, which stay within a few turns of [0, 2pi).
+template <typename V>
+void simd_sincos(typename V::F x, typename V::F& sin_x, typename V::F& cos_x) {
+  using F = typename V::F;
+  using I = typename V::I;
+
+  F quadrant = V::round(V::mul(x, V::set1(2.0f / simd_pi)));
+  F r = V::fnmadd(quadrant, V::set1(1.5703125f), x);
+  r = V::fnmadd(quadrant, V::set1(4.837512969970703125e-4f), r);
+  r = V::fnmadd(quadrant, V::set1(7.54978995489188216e-8f), r);
+  F z = V::mul(r, r);
+
+  F sin_poly = V::fmadd(z, V::set1(-1.9515295891e-4f), V::set1(8.3321608736e-3f));
+  sin_poly = V::fmadd(z, sin_poly, V::set1(-1.6666654611e-1f));
+  sin_poly = V::fmadd(V::mul(z, r), sin_poly, r);
+
+  F cos_poly = V::fmadd(z, V::set1(2.443315711809948e-5f), V::set1(-1.388731625493765e-3f));
+  cos_poly = V::fmadd(z, cos_poly, V::set1(4.166664568298827e-2f));
+  cos_poly = V::fmadd(V::mul(z, z), cos_poly, V::fnmadd(z, V::set1(0.5f), V::set1(1.0f)));
+
+  I q = V::to_int(quadrant);
+  auto is_swapped = V::eqi(V::andi(q, V::set1i(1)), V::set1i(1));
+  auto is_sin_negative = V::eqi(V::andi(q, V::set1i(2)), V::set1i(2));
+  auto is_cos_negative = V::eqi(V::andi(V::addi(q, V::set1i(1)), V::set1i(2)), V::set1i(2));
+
+  F s = V::select(is_swapped, cos_poly, sin_poly);
+  F c = V::select(is_swapped, sin_poly, cos_poly);
+  sin_x = V::select(is_sin_negative, V::neg(s), s);
+  cos_x = V::select(is_cos_negative, V::neg(c), c);
+}
+
+template <typename V>
+void simd_triple32(typename V::I& x) {
+  x = V::xori(x, V::template srli<17>(x));
+  x = V::muli(x, V::set1i(0xed5ad4bbU));
+  x = V::xori(x, V::template srli<11>(x));
+  x = V::muli(x, V::set1i(0xac4c1b51U));
+  x = V::xori(x, V::template srli<15>(x));
+  x = V::muli(x, V::set1i(0x31848babU));
+  x = V::xori(x, V::template srli<14>(x));
+}
+
+// Sums the (2 * sensor_size + 1)^2 texels around each sensor with masked gathers, in the same
+// order as CpuEngine::sense.
+template <typename V>
+typename V::F simd_sense(const AgentKernelParams& params, const float* trail_map, typename V::F x, typename V::F y, typename V::F angle) {
+  using F = typename V::F;
+  using I = typename V::I;
+
+  F sin_angle, cos_angle;
+  simd_sincos<V>(angle, sin_angle, cos_angle);
+  x = V::fmadd(cos_angle, V::set1(params.sensor_range), x);
+  y = V::fmadd(sin_angle, V::set1(params.sensor_range), y);
+
+  I res_x = V::set1i(params.res_x);
+  I minus_one = V::set1i(~0u);
+  I first_row = V::set1i(params.first_row), end_row = V::set1i(params.end_row);
+  I base_x = V::to_int(V::mul(x, V::set1(static_cast<float>(params.res_x))));
+  I base_y = V::to_int(V::mul(y, V::set1(static_cast<float>(params.res_y))));
+
+  F sum = V::set1(0.0f);
+  int size = params.sensor_size;
+  for (int dx = -size; dx <= size; ++dx) {
+    I sample_x = V::addi(base_x, V::set1i(dx));
+    auto is_x_in_bounds = V::mand(V::lti(minus_one, sample_x), V::lti(sample_x, res_x));
+    for (int dy = -size; dy <= size; ++dy) {
+      I sample_y = V::addi(base_y, V::set1i(dy));
+      auto is_in_window = V::mand(V::lti(V::addi(first_row, minus_one), sample_y), V::lti(sample_y, end_row));
+      auto is_in_bounds = V::mand(is_x_in_bounds, is_in_window);
+      I index = V::addi(V::muli(V::subi(sample_y, first_row), res_x), sample_x);
+      sum = V::add(sum, V::gather(trail_map, index, is_in_bounds));
+    }
+  }
+
+  return sum;
+}
+
+template <typename V>
+std::size_t simd_update_agents(const AgentKernelParams& params, const AgentKernelData& data, std::size_t begin, std::size_t end) {
+  using F = typename V::F;
+  using I = typename V::I;
+
+  const F zero = V::set1(0.0f), one = V::set1(1.0f), pi = V::set1(simd_pi), two_pi = V::set1(2.0f * simd_pi);
+  const F turn = V::set1(params.turn_speed * params.dt);
+  const F half_span = V::set1(params.sensor_span / 2.0f);
+  const F res_x = V::set1(static_cast<float>(params.res_x)), res_y = V::set1(static_cast<float>(params.res_y));
+  const I res_xi = V::set1i(params.res_x), res_yi = V::set1i(params.res_y);
+
+  std::size_t id = begin;
+  for (; id + V::width <= end; id += V::width) {
+    I rand_state = V::xori(V::iota(static_cast<unsigned int>(id)), V::set1i(params.seed));
+    simd_triple32<V>(rand_state);
+    rand_state = V::xori(rand_state, V::set1i(params.step_count));
+    simd_triple32<V>(rand_state);
+
+    F x, y;
+    V::load_xy(&data.positions[id], x, y);
+    F angle = V::load(&data.headings[id]);
+
+    F weight_fwd = simd_sense<V>(params, data.trail_map, x, y, angle);
+    F weight_ccw = simd_sense<V>(params, data.trail_map, x, y, V::add(angle, half_span));
+    F weight_cw = simd_sense<V>(params, data.trail_map, x, y, V::sub(angle, half_span));
+
+    simd_triple32<V>(rand_state);
+    F rand_steer = V::div(V::u32_to_float(rand_state), V::set1(static_cast<float>(~0u)));
+
+    // The branches of the scalar loop, applied from the lowest priority up.
+    F steer = V::mul(rand_steer, turn);
+    F delta = V::select(V::gt(weight_cw, weight_ccw), V::neg(steer), zero);
+    delta = V::select(V::gt(weight_ccw, weight_cw), steer, delta);
+    auto is_fwd_weakest = V::mand(V::lt(weight_fwd, weight_ccw), V::lt(weight_fwd, weight_cw));
+    delta = V::select(is_fwd_weakest, V::mul(V::mul(V::set1(2.0f), V::sub(rand_steer, V::set1(0.5f))), turn), delta);
+    auto is_fwd_strongest = V::mand(V::gt(weight_fwd, weight_ccw), V::gt(weight_fwd, weight_cw));
+    angle = V::add(angle, V::select(is_fwd_strongest, zero, delta));
+
+    F sin_angle, cos_angle;
+    simd_sincos<V>(angle, sin_angle, cos_angle);
+    F speed = V::set1(params.agent_speed * params.dt);
+    x = V::fmadd(cos_angle, speed, x);
+    y = V::fmadd(sin_angle, speed, y);
+
+    auto is_outside_x = V::mor(V::lt(x, zero), V::gt(x, one));
+    angle = V::select(is_outside_x, V::sub(pi, angle), angle);
+    x = V::min(V::max(x, zero), one);
+
+    auto is_outside_y = V::mor(V::lt(y, zero), V::gt(y, one));
+    angle = V::select(is_outside_y, V::neg(angle), angle);
+    y = V::min(V::max(y, zero), one);
+
+    I texel_x = V::to_int(V::mul(x, res_x));
+    I texel_y = V::to_int(V::mul(y, res_y));
+    auto is_in_bounds = V::mand(V::lti(texel_x, res_xi), V::lti(texel_y, res_yi));
+    I deposit = V::addi(V::muli(texel_y, res_xi), texel_x);
+    V::storei(&data.deposits[id], V::selecti(is_in_bounds, deposit, V::set1i(no_deposit)));
+
+    V::store_xy(&data.positions[id], x, y);
+    V::store(&data.headings[id], V::fnmadd(two_pi, V::floor(V::div(angle, two_pi)), angle));
+  }
+
+  return id;
+}
+
+
+// The interior of the row a vector at a time from three overlapping loads; the end texels, which
+// have one neighbour, and whatever is left of the last vector are summed like sum_row_scalar.
+template <typename V>
+void simd_sum_row(const float* row, float* sums, std::size_t width) {
+  if (width < V::width + 2) {
+    sum_row_scalar(row, sums, width);
+    return;
+  }
+
+  sums[0] = row[0] + row[1];
+  std::size_t x = 1;
+  for (; x + V::width < width; x += V::width) {
+    V::store(&sums[x], V::add(V::add(V::load(&row[x - 1]), V::load(&row[x])), V::load(&row[x + 1])));
+  }
+  for (; x + 1 < width; ++x) {
+    sums[x] = row[x - 1] + row[x] + row[x + 1];
+  }
+  sums[width - 1] = row[width - 2] + row[width - 1];
+}
+
+// The mix is a single fused multiply-add, so results differ from diffuse_row_scalar in the last
+// bits.
+template <typename V>
+void simd_diffuse_row(const float* original, const float* above, const float* middle, const float* below, float* output, std::size_t width, float diffuse, float evaporate) {
+  using F = typename V::F;
+
+  F nine = V::set1(9.0f), diffuse_v = V::set1(diffuse), evaporate_v = V::set1(evaporate), zero = V::set1(0.0f);
+  std::size_t x = 0;
+  for (; x + V::width <= width; x += V::width) {
+    F blur = V::div(V::add(V::add(V::load(&above[x]), V::load(&middle[x])), V::load(&below[x])), nine);
+    F source = V::load(&original[x]);
+    F diffused = V::fmadd(V::sub(blur, source), diffuse_v, source);
+    V::store(&output[x], V::max(V::sub(diffused, evaporate_v), zero));
+  }
+  diffuse_row_scalar(&original[x], &above[x], &middle[x], &below[x], &output[x], width - x, diffuse, evaporate);
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,226 @@
+#include "distributed.h"
+#include "communicator.h"
+#include "cpu_engine.h"
+#include <fmt/core.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#define DISTRIBUTED_DELTA_TIME (1.0f / 60.0f)
+
+namespace {
+
+// A count followed by the positions, headings and ids of that many agents.
+std::vector<std::byte> pack_agents(const Agents& agents) {
+  std::uint64_t count = agents.size();
+  std::vector<std::byte> bytes(sizeof(count) + count * (sizeof(glm::vec2) + sizeof(float) + sizeof(unsigned int)));
+  std::byte* cursor = bytes.data();
+  auto write = [&](const void* data, std::size_t size) {
+    std::memcpy(cursor, data, size);
+    cursor += size;
+  };
+
+  write(&count, sizeof(count));
+  write(agents.positions.data(), count * sizeof(glm::vec2));
+  write(agents.headings.data(), count * sizeof(float));
+  write(agents.ids.data(), count * sizeof(unsigned int));
+  return bytes;
+}
+
+void unpack_agents(const std::vector<std::byte>& bytes, Agents& agents) {
+  const std::byte* cursor = bytes.data();
+  auto read = [&](void* data, std::size_t size) {
+    if (cursor + size > bytes.data() + bytes.size()) {
+      throw std::runtime_error("Received a truncated list of agents.");
+    }
+    std::memcpy(data, cursor, size);
+    cursor += size;
+  };
+
+  std::uint64_t count = 0;
+  read(&count, sizeof(count));
+  std::size_t offset = agents.size();
+  agents.positions.resize(offset + count);
+  agents.headings.resize(offset + count);
+  agents.ids.resize(offset + count);
+  read(&agents.positions[offset], count * sizeof(glm::vec2));
+  read(&agents.headings[offset], count * sizeof(float));
+  read(&agents.ids[offset], count * sizeof(unsigned int));
+}
+
+// Rank r owns the rows [row_begins[r], row_begins[r + 1]).
+class RowExchanger : public RowExchange {
+public:
+  RowExchanger(Communicator& communicator, std::vector<unsigned int> row_begins, unsigned int halo_rows, unsigned int res_x, unsigned int res_y)
+    : communicator { communicator }, row_begins { std::move(row_begins) }, halo_rows { halo_rows }, res_x { res_x }, res_y { res_y } {}
+
+  // Agents can travel any distance in one step, so every rank trades with every other, rank r
+  // sending to r + k and receiving from r - k in round k.
+  Agents migrate_agents(const Agents& leaving) override {
+    int rank = communicator.rank(), size = communicator.size();
+    std::vector<Agents> outgoing(size);
+    for (std::size_t id = 0; id < leaving.size(); ++id) {
+      auto& agents = outgoing[owner(leaving.positions[id])];
+      agents.positions.push_back(leaving.positions[id]);
+      agents.headings.push_back(leaving.headings[id]);
+      agents.ids.push_back(leaving.ids[id]);
+    }
+
+    Agents arrived;
+    for (int k = 1; k < size; ++k) {
+      int destination = (rank + k) % size, source = (rank - k + size) % size;
+      unpack_agents(communicator.send_receive(destination, pack_agents(outgoing[destination]), source), arrived);
+    }
+    return arrived;
+  }
+
+  // Rows go down to the next rank and come back up from it in two rounds, so every pair of
+  // neighbours trades at the same time.
+  void exchange_halos(std::vector<float>& trail_map) override {
+    int rank = communicator.rank(), size = communicator.size();
+    unsigned int owned_begin = row_begins[rank], owned_end = row_begins[rank + 1];
+    unsigned int window_begin = owned_begin - std::min(owned_begin, halo_rows);
+    auto rows = [&](unsigned int first_row, unsigned int row_count) {
+      return std::span<float> { &trail_map[static_cast<std::size_t>(first_row - window_begin) * res_x], static_cast<std::size_t>(row_count) * res_x };
+    };
+    auto receive_into = [&](std::span<float> target, const std::vector<std::byte>& bytes) {
+      if (bytes.size() != target.size_bytes()) {
+        throw std::runtime_error(fmt::format("Rank {} received {} bytes of halo instead of {}.", rank, bytes.size(), target.size_bytes()));
+      }
+      std::memcpy(target.data(), bytes.data(), bytes.size());
+    };
+
+    int above = (rank > 0 ? rank - 1 : no_rank), below = (rank + 1 < size ? rank + 1 : no_rank);
+    std::span<const std::byte> bottom_rows, top_rows;
+    if (below != no_rank) {
+      bottom_rows = std::as_bytes(rows(owned_end - halo_rows, halo_rows));
+    }
+    if (above != no_rank) {
+      top_rows = std::as_bytes(rows(owned_begin, halo_rows));
+    }
+
+    auto from_above = communicator.send_receive(below, bottom_rows, above);
+    if (above != no_rank) {
+      receive_into(rows(owned_begin - halo_rows, halo_rows), from_above);
+    }
+    auto from_below = communicator.send_receive(above, top_rows, below);
+    if (below != no_rank) {
+      receive_into(rows(owned_end, halo_rows), from_below);
+    }
+  }
+
+private:
+  Communicator& communicator;
+  std::vector<unsigned int> row_begins;
+  unsigned int halo_rows;
+  unsigned int res_x, res_y;
+
+  int owner(glm::vec2 position) const {
+    unsigned int row = std::min(static_cast<unsigned int>(position.y * res_y), res_y - 1);
+    return std::upper_bound(row_begins.begin(), row_begins.end(), row) - row_begins.begin() - 1;
+  }
+};
+
+}
+
+void run_distributed(const ApplicationConfig& distributed_config) {
+  if (distributed_config.backend != Backend::cpu) {
+    throw std::runtime_error("A distributed run needs the cpu backend.");
+  }
+  if (distributed_config.frame_limit == 0) {
+    throw std::runtime_error("A distributed run needs a frame_limit.");
+  }
+  if (!distributed_config.headless) {
+    throw std::runtime_error("A distributed run needs headless, it has no window.");
+  }
+  if (!distributed_config.record_path.empty()) {
+    throw std::runtime_error("A distributed run can't record frames.");
+  }
+  if (!distributed_config.checkpoint_path.empty() || distributed_config.checkpoint_interval != 0) {
+    throw std::runtime_error("A distributed run can't write checkpoints.");
+  }
+  if (!distributed_config.restore_path.empty()) {
+    throw std::runtime_error("A distributed run can't restore a checkpoint.");
+  }
+  if (distributed_config.profile_gpu) {
+    throw std::runtime_error("A distributed run has no GPU to profile.");
+  }
+
+  // Every rank generates the agents of the same seed.
+  ApplicationConfig config = distributed_config;
+  if (!config.deterministic) {
+    std::random_device dev;
+    config.seed = dev();
+  }
+
+  int process_count = config.process_count;
+  if (config.thread_count == 0) {
+    config.thread_count = std::max(1u, std::thread::hardware_concurrency() / process_count);
+  }
+
+  // Sensors reach sensor_range plus sensor_size texels from an agent, and one more row keeps the
+  // rows they read diffused like the neighbour diffuses them.
+  unsigned int res_y = config.sim_res_y;
+  unsigned int halo_rows = static_cast<unsigned int>(std::ceil(config.sensor_range * res_y)) + std::max(config.sensor_size, 0) + 2;
+  std::vector<unsigned int> row_begins;
+  for (int rank = 0; rank <= process_count; ++rank) {
+    row_begins.push_back(static_cast<unsigned int>(static_cast<std::uint64_t>(rank) * res_y / process_count));
+  }
+  if (res_y / process_count < halo_rows) {
+    throw std::runtime_error(fmt::format(
+      "{} processes leave {} rows each, fewer than the {} halo rows the sensors need.",
+      process_count, res_y / process_count, halo_rows
+    ));
+  }
+
+  unsigned int substeps = std::max(config.substeps, 1u);
+  float step_delta_time = (config.fixed_dt > 0.0f ? config.fixed_dt : DISTRIBUTED_DELTA_TIME / substeps);
+  unsigned int step_count = config.frame_limit * substeps;
+
+  run_local_ranks(process_count, [&](Communicator& communicator) {
+    int rank = communicator.rank();
+    RowExchanger exchanger { communicator, row_begins, halo_rows, config.sim_res_x, res_y };
+    CpuEngine engine { config, RowDomain { row_begins[rank], row_begins[rank + 1], halo_rows, &exchanger } };
+
+    auto start_time = std::chrono::steady_clock::now();
+    for (unsigned int step = 0; step < step_count; ++step) {
+      engine.step(config, step_delta_time);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+
+    std::size_t row_offset = static_cast<std::size_t>(row_begins[rank] - engine.first_row()) * config.sim_res_x;
+    std::span<const float> owned_rows {
+      engine.trail_map().data() + row_offset, static_cast<std::size_t>(row_begins[rank + 1] - row_begins[rank]) * config.sim_res_x
+    };
+    if (rank != 0) {
+      communicator.send(0, std::as_bytes(owned_rows));
+      return;
+    }
+
+    std::vector<float> trail_map(owned_rows.begin(), owned_rows.end());
+    for (int source = 1; source < process_count; ++source) {
+      auto bytes = communicator.receive(source);
+      std::size_t offset = trail_map.size();
+      trail_map.resize(offset + bytes.size() / sizeof(float));
+      std::memcpy(&trail_map[offset], bytes.data(), bytes.size());
+    }
+
+    double sum = 0.0, sum_squares = 0.0;
+    for (float value : trail_map) {
+      sum += value, sum_squares += static_cast<double>(value) * value;
+    }
+    double mean = sum / trail_map.size();
+    double stddev = std::sqrt(std::max(0.0, sum_squares / trail_map.size() - mean * mean));
+
+    fmt::println(
+      "{} frames ({} steps) in {:.3f}s [{:.1f} FPS, {:.1f} steps/s] across {} processes",
+      config.frame_limit, step_count, elapsed.count(), config.frame_limit / elapsed.count(), step_count / elapsed.count(), process_count
+    );
+    fmt::println("trail_mean {:.6f}, trail_stddev {:.6f}", mean, stddev);
+  });
+}
\ No newline at end of file
@@ -0,0 +1,10 @@
+#pragma once
+#include "application_config.h"
+
+// Splits the trail map into one band of rows per process and steps a CpuEngine on each band for
+// config.frame_limit frames, in config.process_count processes on this machine. Every step the
+// processes trade the agents that crossed into another band and the rows along their borders;
+// at the end rank 0 gathers the trail map and prints its mean and standard deviation. Throws for
+// the options a distributed run doesn't support: the gpu backend, a window, recording,
+// checkpoints and GPU profiling.
+void run_distributed(const ApplicationConfig&);
\ No newline at end of file
@@ -0,0 +1,223 @@
+#include "frame_recorder.h"
+#include <glad/glad.h>
+#include <fmt/core.h>
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+#define Y4M_FRAME_RATE "60:1"
+
+namespace {
+
+// A PNG needs zlib data, but not compressed data: stored deflate blocks keep the encoder
+// dependency free and cheap, at the cost of file size.
+constexpr std::size_t max_stored_block_size = 65535;
+
+std::uint32_t crc32(const std::uint8_t* data, std::size_t size, std::uint32_t crc = 0) {
+  static const auto table = [] {
+    std::array<std::uint32_t, 256> table;
+    for (std::uint32_t i = 0; i < table.size(); ++i) {
+      std::uint32_t value = i;
+      for (int bit = 0; bit < 8; ++bit) {
+        value = (value & 1 ? 0xedb88320u ^ (value >> 1) : value >> 1);
+      }
+      table[i] = value;
+    }
+    return table;
+  }();
+
+  crc = ~crc;
+  for (std::size_t i = 0; i < size; ++i) {
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+void append_u32(std::vector<std::uint8_t>& out, std::uint32_t value) {
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out.push_back(static_cast<std::uint8_t>(value >> shift));
+  }
+}
+
+void append_chunk(std::vector<std::uint8_t>& out, const char* type, const std::vector<std::uint8_t>& data) {
+  append_u32(out, data.size());
+  std::size_t type_begin = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  append_u32(out, crc32(&out[type_begin], out.size() - type_begin));
+}
+
+}
+
+FrameRecorder::FrameRecorder(const std::string& _path, RecordFormat _format, unsigned int _width, unsigned int _height)
+  : path { _path }, format { _format }, width { _width }, height { _height } {
+  if (format == RecordFormat::y4m) {
+    y4m_file.open(path, std::ios::binary);
+    if (!y4m_file) {
+      throw std::runtime_error(fmt::format("Failed to open recording '{}'.", path));
+    }
+    y4m_file << fmt::format("YUV4MPEG2 W{} H{} F" Y4M_FRAME_RATE " Ip A1:1 Cmono\n", width, height);
+  } else {
+    std::error_code error;
+    std::filesystem::create_directories(path, error);
+    if (error) {
+      throw std::runtime_error(fmt::format("Failed to create recording directory '{}'.", path));
+    }
+  }
+
+  worker = std::thread { [this] { worker_loop(); } };
+}
+
+FrameRecorder::~FrameRecorder() {
+  if (pixel_buffers[0] != 0) {
+    flush();
+    glDeleteBuffers(pixel_buffers.size(), pixel_buffers.data());
+  }
+
+  {
+    std::lock_guard lock { mutex };
+    stopping = true;
+  }
+  condition.notify_all();
+  worker.join();
+}
+
+void FrameRecorder::capture_texture(unsigned int texture) {
+  if (pixel_buffers[0] == 0) {
+    init_pixel_buffers();
+  }
+
+  // Only a full ring waits, on the readback issued ring_size frames ago, which has long finished.
+  if (write_index - read_index == ring_size) {
+    read_pixel_buffer();
+  }
+
+  std::size_t slot = write_index % ring_size;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffers[slot]);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glGetTextureImage(texture, 0, GL_RED, GL_UNSIGNED_BYTE, width * height, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  buffer_frames[slot] = frame_count++;
+  ++write_index;
+}
+
+void FrameRecorder::capture_pixels(const std::vector<float>& pixels) {
+  Frame frame { frame_count++, std::vector<std::uint8_t>(pixels.size()) };
+  std::transform(pixels.begin(), pixels.end(), frame.pixels.begin(), [](float value) {
+    return static_cast<std::uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+  });
+  enqueue(std::move(frame));
+}
+
+void FrameRecorder::flush() {
+  while (read_index < write_index) {
+    read_pixel_buffer();
+  }
+}
+
+void FrameRecorder::init_pixel_buffers() {
+  glCreateBuffers(pixel_buffers.size(), pixel_buffers.data());
+  for (auto buffer : pixel_buffers) {
+    glNamedBufferStorage(buffer, width * height, nullptr, GL_MAP_READ_BIT);
+  }
+}
+
+void FrameRecorder::read_pixel_buffer() {
+  std::size_t slot = read_index % ring_size;
+  auto fence = static_cast<GLsync>(fences[slot]);
+  glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+  glDeleteSync(fence);
+
+  std::size_t size = width * height;
+  auto data = static_cast<const std::uint8_t*>(glMapNamedBufferRange(pixel_buffers[slot], 0, size, GL_MAP_READ_BIT));
+  Frame frame { buffer_frames[slot], std::vector<std::uint8_t>(data, data + size) };
+  glUnmapNamedBuffer(pixel_buffers[slot]);
+
+  ++read_index;
+  enqueue(std::move(frame));
+}
+
+void FrameRecorder::enqueue(Frame frame) {
+  {
+    std::unique_lock lock { mutex };
+    queue_space.wait(lock, [this] { return frames.size() < max_queued_frames; });
+    frames.push(std::move(frame));
+  }
+  condition.notify_one();
+}
+
+void FrameRecorder::worker_loop() {
+  while (true) {
+    Frame frame;
+    {
+      std::unique_lock lock { mutex };
+      condition.wait(lock, [this] { return stopping || !frames.empty(); });
+      if (stopping && frames.empty()) return;
+      frame = std::move(frames.front());
+      frames.pop();
+    }
+    queue_space.notify_one();
+
+    if (format == RecordFormat::y4m) {
+      write_y4m(frame);
+    } else {
+      write_png(frame);
+    }
+  }
+}
+
+// Texture rows start at the bottom of the image, both formats start at the top.
+void FrameRecorder::write_y4m(const Frame& frame) {
+  y4m_file << "FRAME\n";
+  for (unsigned int y = height; y-- > 0;) {
+    y4m_file.write(reinterpret_cast<const char*>(&frame.pixels[y * width]), width);
+  }
+}
+
+void FrameRecorder::write_png(const Frame& frame) const {
+  std::vector<std::uint8_t> header;
+  append_u32(header, width);
+  append_u32(header, height);
+  header.insert(header.end(), { 8, 0, 0, 0, 0 });
+
+  // Every row is prefixed by its filter type, 0 for none.
+  std::vector<std::uint8_t> rows;
+  rows.reserve((width + 1) * height);
+  for (unsigned int y = height; y-- > 0;) {
+    rows.push_back(0);
+    rows.insert(rows.end(), &frame.pixels[y * width], &frame.pixels[y * width] + width);
+  }
+
+  std::vector<std::uint8_t> zlib_data { 0x78, 0x01 };
+  std::uint32_t adler_a = 1, adler_b = 0;
+  for (std::size_t offset = 0; offset < rows.size(); offset += max_stored_block_size) {
+    std::size_t size = std::min(max_stored_block_size, rows.size() - offset);
+    bool is_last = (offset + size == rows.size());
+    zlib_data.insert(zlib_data.end(), {
+      static_cast<std::uint8_t>(is_last),
+      static_cast<std::uint8_t>(size), static_cast<std::uint8_t>(size >> 8),
+      static_cast<std::uint8_t>(~size), static_cast<std::uint8_t>(~size >> 8),
+    });
+    zlib_data.insert(zlib_data.end(), &rows[offset], &rows[offset] + size);
+
+    for (std::size_t i = offset; i < offset + size; ++i) {
+      adler_a = (adler_a + rows[i]) % 65521;
+      adler_b = (adler_b + adler_a) % 65521;
+    }
+  }
+  append_u32(zlib_data, (adler_b << 16) | adler_a);
+
+  std::vector<std::uint8_t> png { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  append_chunk(png, "IHDR", header);
+  append_chunk(png, "IDAT", zlib_data);
+  append_chunk(png, "IEND", {});
+
+  auto file_path = std::filesystem::path(path) / fmt::format("frame_{:06}.png", frame.index);
+  std::ofstream file { file_path, std::ios::binary };
+  file.write(reinterpret_cast<const char*>(png.data()), png.size());
+  if (!file) {
+    fmt::println("Failed to write recording frame '{}'.", file_path.string());
+  }
+}
\ No newline at end of file
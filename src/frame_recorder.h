@@ -0,0 +1,69 @@
+#pragma once
+#include "application_config.h"
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Records the trail map as 8 bit greyscale frames. Textures are read back through a ring of pixel
+// buffer objects that are mapped a few frames later, once their fences have signalled, and a
+// worker thread encodes the frames, so neither the GPU nor the disk stalls the simulation. Only
+// max_queued_frames wait for the worker, so a simulation outpacing the disk waits for it rather
+// than holding every frame in memory.
+// A y4m recording is a single file at `path`, a png recording is a directory of numbered images.
+class FrameRecorder {
+public:
+  FrameRecorder(const std::string& path, RecordFormat, unsigned int width, unsigned int height);
+  ~FrameRecorder();
+
+  FrameRecorder(const FrameRecorder&) = delete;
+  FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+  // Needs the GL context the texture belongs to.
+  void capture_texture(unsigned int texture);
+  // Single-channel values in [0, 1], row by row like CpuEngine::trail_map().
+  void capture_pixels(const std::vector<float>&);
+
+  // Waits for the frames still in flight on the GPU and hands them to the encoder.
+  void flush();
+
+private:
+  static constexpr std::size_t ring_size = 3;
+  static constexpr std::size_t max_queued_frames = 4;
+
+  struct Frame {
+    unsigned int index;
+    std::vector<std::uint8_t> pixels;
+  };
+
+  std::string path;
+  RecordFormat format;
+  unsigned int width, height;
+  unsigned int frame_count = 0;
+
+  std::array<unsigned int, ring_size> pixel_buffers {};
+  std::array<void*, ring_size> fences {};
+  std::array<unsigned int, ring_size> buffer_frames {};
+  std::size_t write_index = 0, read_index = 0;
+
+  std::ofstream y4m_file;
+  std::thread worker;
+  std::queue<Frame> frames;
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::condition_variable queue_space;
+  bool stopping = false;
+
+  void init_pixel_buffers();
+  void read_pixel_buffer();
+  void enqueue(Frame);
+  void worker_loop();
+  void write_y4m(const Frame&);
+  void write_png(const Frame&) const;
+};
\ No newline at end of file
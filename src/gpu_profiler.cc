@@ -0,0 +1,123 @@
+#include "gpu_profiler.h"
+#include <glad/glad.h>
+#include <fmt/core.h>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include <stdexcept>
+
+GpuProfiler::GpuProfiler(const std::string& csv_path) {
+  for (auto& pass : passes) {
+    glGenQueries(pass.queries.size(), pass.queries.data());
+  }
+
+  if (!csv_path.empty()) {
+    csv_file.open(csv_path);
+    if (!csv_file) {
+      throw std::runtime_error(fmt::format("Failed to open profile output '{}'.", csv_path));
+    }
+    csv_file << "frame,pass,gpu_ms\n";
+  }
+}
+
+GpuProfiler::~GpuProfiler() {
+  for (auto& pass : passes) {
+    glDeleteQueries(pass.queries.size(), pass.queries.data());
+  }
+}
+
+GpuProfiler::Scope::Scope(GpuProfiler* _profiler, GpuPass _pass) : profiler { _profiler }, pass { _pass } {
+  if (profiler != nullptr) {
+    profiler->begin(pass);
+  }
+}
+
+GpuProfiler::Scope::~Scope() {
+  if (profiler != nullptr) {
+    profiler->end(pass);
+  }
+}
+
+void GpuProfiler::begin_frame(int _frame_count) {
+  frame_count = _frame_count;
+  collect();
+}
+
+void GpuProfiler::begin(GpuPass pass_id) {
+  auto& pass = passes[static_cast<std::size_t>(pass_id)];
+
+  // Drop the sample rather than wait when every query of the ring is still in flight.
+  pass.is_recording = (pass.write_index - pass.read_index < ring_size);
+  if (!pass.is_recording) return;
+
+  std::size_t slot = pass.write_index % ring_size;
+  pass.frames[slot] = frame_count;
+  glQueryCounter(pass.queries[2 * slot], GL_TIMESTAMP);
+}
+
+void GpuProfiler::end(GpuPass pass_id) {
+  auto& pass = passes[static_cast<std::size_t>(pass_id)];
+  if (!pass.is_recording) return;
+
+  std::size_t slot = pass.write_index % ring_size;
+  glQueryCounter(pass.queries[2 * slot + 1], GL_TIMESTAMP);
+  ++pass.write_index;
+  pass.is_recording = false;
+}
+
+void GpuProfiler::collect() {
+  for (std::size_t pass_index = 0; pass_index < gpu_pass_count; ++pass_index) {
+    auto& pass = passes[pass_index];
+    while (pass.read_index < pass.write_index) {
+      std::size_t slot = pass.read_index % ring_size;
+
+      int is_available = GL_FALSE;
+      glGetQueryObjectiv(pass.queries[2 * slot + 1], GL_QUERY_RESULT_AVAILABLE, &is_available);
+      if (!is_available) break;
+
+      GLuint64 start_time, end_time;
+      glGetQueryObjectui64v(pass.queries[2 * slot], GL_QUERY_RESULT, &start_time);
+      glGetQueryObjectui64v(pass.queries[2 * slot + 1], GL_QUERY_RESULT, &end_time);
+      double elapsed_ms = (end_time - start_time) / 1e6;
+      ++pass.read_index;
+
+      pass.history.push_back(elapsed_ms);
+      if (pass.history.size() > history_size) {
+        pass.history.pop_front();
+      }
+
+      if (csv_file.is_open()) {
+        csv_file << fmt::format("{},{},{:.6f}\n", pass.frames[slot], pass_name(static_cast<GpuPass>(pass_index)), elapsed_ms);
+      }
+    }
+  }
+}
+
+GpuProfiler::PassStats GpuProfiler::stats(GpuPass pass_id) const {
+  const auto& history = passes[static_cast<std::size_t>(pass_id)].history;
+  if (history.empty()) {
+    return { 0, 0.0, 0.0, 0.0, 0.0 };
+  }
+
+  std::vector<double> samples { history.begin(), history.end() };
+  std::sort(samples.begin(), samples.end());
+  auto percentile = [&](double p) {
+    return samples[static_cast<std::size_t>(p * (samples.size() - 1) + 0.5)];
+  };
+
+  double mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+  return { samples.size(), mean, percentile(0.5), percentile(0.95), percentile(0.99) };
+}
+
+const char* GpuProfiler::pass_name(GpuPass pass) {
+  constexpr const char* names[gpu_pass_count] = {
+    "agents_sort",
+    "agents_update",
+    "agents_deposit",
+    "screen_update",
+    "trail_upload",
+    "screen_quad",
+    "imgui",
+  };
+  return names[static_cast<std::size_t>(pass)];
+}
\ No newline at end of file
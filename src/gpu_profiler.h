@@ -0,0 +1,72 @@
+#pragma once
+#include <array>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <cstddef>
+
+enum class GpuPass {
+  agents_sort,
+  agents_update,
+  agents_deposit,
+  screen_update,
+  trail_upload,
+  screen_quad,
+  imgui,
+};
+
+constexpr std::size_t gpu_pass_count = 7;
+
+// Times GPU passes with GL_TIMESTAMP queries. Each pass owns a ring of query pairs that is read
+// back a few frames later, once the results are available, so the CPU never waits on the GPU.
+class GpuProfiler {
+public:
+  GpuProfiler(const std::string& csv_path);
+  ~GpuProfiler();
+
+  GpuProfiler(const GpuProfiler&) = delete;
+  GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+  class Scope {
+  public:
+    Scope(GpuProfiler*, GpuPass);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    GpuProfiler* profiler;
+    GpuPass pass;
+  };
+
+  struct PassStats {
+    std::size_t sample_count;
+    double mean_ms, p50_ms, p95_ms, p99_ms;
+  };
+
+  void begin_frame(int frame_count);
+  void begin(GpuPass);
+  void end(GpuPass);
+
+  PassStats stats(GpuPass) const;
+  static const char* pass_name(GpuPass);
+
+private:
+  static constexpr std::size_t ring_size = 64;
+  static constexpr std::size_t history_size = 240;
+
+  struct PassQueries {
+    std::array<unsigned int, 2 * ring_size> queries;
+    std::array<int, ring_size> frames;
+    std::size_t write_index = 0, read_index = 0;
+    bool is_recording = false;
+    std::deque<double> history;
+  };
+
+  std::array<PassQueries, gpu_pass_count> passes;
+  int frame_count = 0;
+  std::ofstream csv_file;
+
+  void collect();
+};
\ No newline at end of file
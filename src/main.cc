@@ -1,8 +1,11 @@
 #include "application.h"
+#include "config_loader.h"
+#include "sweep.h"
+#include "distributed.h"
 #include <exception>
 #include <fmt/core.h>
 
-int main() {
+int main(int argc, char** argv) {
   try {
     ApplicationConfig config = {
       .window_x = 1920,
@@ -18,13 +21,55 @@ int main() {
       .sensor_span = 15.0,
       .sensor_range = 0.025,
       .sensor_size = 1,
+      .trail_format = TrailFormat::rgba32f,
+      .tiled_diffusion = true,
+      .fused_pipeline = false,
+      .sparse_tiles = false,
+      .deposit_mode = DepositMode::overwrite,
+      .deposit_amount = 0.25,
+      .sort_interval = 64,
+      .deterministic = false,
+      .seed = 0,
+      .backend = Backend::gpu,
+      .thread_count = 0,
+      .numa_placement = false,
+      .process_count = 1,
+      .simd_kernels = true,
+      .headless = false,
+      .frame_limit = 0,
+      .fixed_dt = 0.0,
+      .substeps = 1,
+      .profile_gpu = false,
+      .profile_csv_path = "",
+      .record_path = "",
+      .record_format = RecordFormat::y4m,
+      .checkpoint_path = "",
+      .checkpoint_interval = 0,
+      .restore_path = "",
+      .sweep = "",
+      .program_cache_dir = "shader_cache",
     };
 
+    if (!parse_command_line(config, argc, argv)) {
+      return 0;
+    }
+
+    if (!config.sweep.empty()) {
+      run_sweep(config);
+      return 0;
+    }
+
+    if (config.process_count > 1) {
+      run_distributed(config);
+      return 0;
+    }
+
     Application app { config };
     app.run();
 
   } catch (const std::exception& e) {
     fmt::println("Exception occured: {}", e.what());
+    return 1;
   }
 
   return 0;
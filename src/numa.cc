@@ -0,0 +1,96 @@
+#include "numa.h"
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// "0-15,32-47" to 0, 1, ..., 15, 32, ..., 47.
+std::vector<unsigned int> parse_cpu_list(const std::string& list) {
+  std::vector<unsigned int> cpus;
+  const char* cursor = list.data();
+  const char* end = list.data() + list.size();
+  while (cursor < end) {
+    unsigned int first = 0, last = 0;
+    auto result = std::from_chars(cursor, end, first);
+    if (result.ec != std::errc {}) break;
+    last = first;
+    if (result.ptr < end && *result.ptr == '-') {
+      result = std::from_chars(result.ptr + 1, end, last);
+      if (result.ec != std::errc {}) break;
+    }
+
+    for (unsigned int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+    cursor = (result.ptr < end && *result.ptr == ',' ? result.ptr + 1 : end);
+  }
+  return cpus;
+}
+
+}
+
+NumaTopology numa_topology() {
+  NumaTopology topology;
+
+#ifdef __linux__
+  std::vector<std::pair<unsigned int, std::vector<unsigned int>>> nodes;
+  std::error_code error;
+  for (const auto& entry : std::filesystem::directory_iterator { "/sys/devices/system/node", error }) {
+    std::string name = entry.path().filename().string();
+    unsigned int node = 0;
+    if (!name.starts_with("node") || std::from_chars(name.data() + 4, name.data() + name.size(), node).ec != std::errc {}) {
+      continue;
+    }
+
+    std::string cpu_list;
+    std::getline(std::ifstream { entry.path() / "cpulist" }, cpu_list);
+    if (auto cpus = parse_cpu_list(cpu_list); !cpus.empty()) {
+      nodes.emplace_back(node, std::move(cpus));
+    }
+  }
+
+  std::ranges::sort(nodes);
+  for (auto& [node, cpus] : nodes) {
+    topology.node_cpus.push_back(std::move(cpus));
+  }
+#endif
+
+  if (topology.node_cpus.empty()) {
+    topology.node_cpus.emplace_back();
+  }
+  return topology;
+}
+
+void pin_thread_to_node(const NumaTopology& topology, std::size_t node) {
+#ifdef __linux__
+  if (topology.node_cpus[node].empty()) return;
+
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (unsigned int cpu : topology.node_cpus[node]) {
+    CPU_SET(cpu, &cpu_set);
+  }
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+#endif
+}
+
+void release_pages(void* data, std::size_t size) {
+#ifdef __linux__
+  std::size_t page_size = sysconf(_SC_PAGESIZE);
+  std::size_t begin = (reinterpret_cast<std::size_t>(data) + page_size - 1) / page_size * page_size;
+  std::size_t end = (reinterpret_cast<std::size_t>(data) + size) / page_size * page_size;
+  if (begin < end) {
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+  }
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+// The NUMA nodes of the machine and the CPUs of each, read from sysfs. Machines without NUMA, and
+// platforms other than Linux, report a single node.
+struct NumaTopology {
+  std::vector<std::vector<unsigned int>> node_cpus;
+
+  std::size_t node_count() const { return node_cpus.size(); }
+};
+
+NumaTopology numa_topology();
+
+// Restricts the calling thread to the CPUs of one node. Does nothing off Linux.
+void pin_thread_to_node(const NumaTopology&, std::size_t node);
+
+// Hands the whole pages inside [data, data + size) back to the kernel, so each is allocated again
+// on the node of the thread that touches it first. Their contents read as zero afterwards.
+void release_pages(void* data, std::size_t size);
\ No newline at end of file
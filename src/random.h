@@ -0,0 +1,26 @@
+#pragma once
+
+// https://nullprogram.com/blog/2018/07/31/
+inline void triple32(unsigned int& x) {
+  x ^= x >> 17;
+  x *= 0xed5ad4bbU;
+  x ^= x >> 11;
+  x *= 0xac4c1b51U;
+  x ^= x >> 15;
+  x *= 0x31848babU;
+  x ^= x >> 14;
+}
+
+// Counter-based random stream for one agent at one step, the same as in agents_update.comp.
+inline unsigned int agent_rand_state(unsigned int agent_id, unsigned int step, unsigned int seed) {
+  unsigned int state = agent_id ^ seed;
+  triple32(state);
+  state ^= step;
+  triple32(state);
+  return state;
+}
+
+inline float rand_float(unsigned int& rand_state) {
+  triple32(rand_state);
+  return static_cast<float>(rand_state) / static_cast<float>(~0u);
+}
\ No newline at end of file
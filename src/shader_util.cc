@@ -1,17 +1,77 @@
 #include "shader_util.h"
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <fmt/core.h>
 #include <fstream>
+#include <filesystem>
 #include <array>
+#include <vector>
+#include <random>
+#include <cstdint>
 #include <stdexcept>
 
+namespace {
+
+// FNV-1a, so cache keys stay stable across runs and standard library versions.
+std::uint64_t fnv1a(const std::string& data, std::uint64_t hash = 0xcbf29ce484222325ull) {
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+std::string gl_string(GLenum name) {
+  const GLubyte* str = glGetString(name);
+  return (str != nullptr ? reinterpret_cast<const char*>(str) : "");
+}
+
+}
+
 std::string Shader::load_source_from_file(std::string path) {
   std::ifstream file { path };
   std::string source {
     std::istreambuf_iterator<char>(file),
     std::istreambuf_iterator<char>()
   };
-  return source;
+
+  // GLSL has no includes of its own, so `#include "name"` lines are replaced by the file they
+  // name, looked up next to the including file.
+  constexpr std::string_view include_directive = "#include \"";
+  std::string expanded;
+  for (std::size_t line_begin = 0; line_begin < source.size();) {
+    std::size_t line_end = source.find('\n', line_begin);
+    line_end = (line_end == std::string::npos ? source.size() : line_end + 1);
+    std::string_view line { &source[line_begin], line_end - line_begin };
+
+    std::size_t name_end = line.find('"', include_directive.size());
+    if (line.starts_with(include_directive) && name_end != std::string_view::npos) {
+      auto name = line.substr(include_directive.size(), name_end - include_directive.size());
+      auto include_path = std::filesystem::path(path).parent_path() / name;
+      if (!std::filesystem::exists(include_path)) {
+        throw std::runtime_error(fmt::format("Shader '{}' includes missing file '{}'.", path, include_path.string()));
+      }
+      expanded += load_source_from_file(include_path.string()) + '\n';
+    } else {
+      expanded += line;
+    }
+    line_begin = line_end;
+  }
+  return expanded;
+}
+
+std::string Shader::insert_defines(const std::string& source, std::initializer_list<std::string> defines) {
+  std::size_t insert_pos = source.find('\n') + 1;
+  if (insert_pos == 0) {
+    throw std::runtime_error("Shader source has no #version directive.");
+  }
+
+  std::string result = source.substr(0, insert_pos);
+  for (const auto& define : defines) {
+    result += "#define " + define + "\n";
+  }
+  result += source.substr(insert_pos);
+  return result;
 }
 
 Shader::Shader(const std::string& source, unsigned int type) {
@@ -35,11 +95,110 @@ Shader::~Shader() {
   glDeleteShader(id);
 }
 
+ProgramCache::ProgramCache(const std::string& _directory) : directory { _directory } {
+  driver_id = gl_string(GL_VENDOR) + '\n' + gl_string(GL_RENDERER) + '\n' + gl_string(GL_VERSION);
+
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+}
+
+std::string ProgramCache::key(std::initializer_list<ShaderSource> sources) const {
+  std::uint64_t hash = fnv1a(driver_id);
+  for (const auto& [source, type] : sources) {
+    hash = fnv1a(std::to_string(type), hash);
+    hash = fnv1a(source, hash);
+  }
+  return fmt::format("{:016x}", hash);
+}
+
+std::string ProgramCache::path(const std::string& key) const {
+  return (std::filesystem::path(directory) / (key + ".bin")).string();
+}
+
+bool ProgramCache::load(unsigned int program, const std::string& key) const {
+  std::ifstream file { path(key), std::ios::binary };
+  if (!file) return false;
+
+  GLenum binary_format;
+  file.read(reinterpret_cast<char*>(&binary_format), sizeof(binary_format));
+  if (file.gcount() != sizeof(binary_format)) return false;
+
+  // The binary is whatever follows the format.
+  file.seekg(0, std::ios::end);
+  std::streamoff binary_size = static_cast<std::streamoff>(file.tellg()) - static_cast<std::streamoff>(sizeof(binary_format));
+  if (!file || binary_size <= 0) return false;
+  file.seekg(sizeof(binary_format));
+  std::vector<char> binary(binary_size);
+  file.read(binary.data(), binary_size);
+  if (file.gcount() != binary_size) return false;
+
+  glProgramBinary(program, binary_format, binary.data(), binary.size());
+  int success;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  return success;
+}
+
+void ProgramCache::store(unsigned int program, const std::string& key) const {
+  int binary_length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binary_length);
+  if (binary_length == 0) return;
+
+  GLenum binary_format;
+  std::vector<char> binary(binary_length);
+  glGetProgramBinary(program, binary_length, nullptr, &binary_format, binary.data());
+
+  // Concurrent runs may store the same key, so write to a private file and rename it into place.
+  std::random_device dev;
+  std::string final_path = path(key);
+  std::string temp_path = fmt::format("{}.{:08x}.tmp", final_path, dev());
+  {
+    std::ofstream file { temp_path, std::ios::binary };
+    file.write(reinterpret_cast<const char*>(&binary_format), sizeof(binary_format));
+    file.write(binary.data(), binary.size());
+    if (!file) return;
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temp_path, final_path, error);
+  if (error) {
+    std::filesystem::remove(temp_path, error);
+  }
+}
+
 ShaderProgram::ShaderProgram(std::initializer_list<unsigned int> shader_ids) {
   id = glCreateProgram();
   for (const auto& shader_id : shader_ids) {
     glAttachShader(id, shader_id);
   }
+  link();
+}
+
+ShaderProgram::ShaderProgram(std::initializer_list<ShaderSource> sources, const ProgramCache* cache) {
+  id = glCreateProgram();
+
+  std::string key = (cache != nullptr ? cache->key(sources) : "");
+  if (cache != nullptr && cache->load(id, key)) {
+    reflect_uniform_locations();
+    return;
+  }
+
+  std::vector<Shader> shaders;
+  shaders.reserve(sources.size());
+  for (const auto& [source, type] : sources) {
+    glAttachShader(id, shaders.emplace_back(source, type).id);
+  }
+
+  if (cache != nullptr) {
+    glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+  link();
+
+  if (cache != nullptr) {
+    cache->store(id, key);
+  }
+}
+
+void ShaderProgram::link() {
   glLinkProgram(id);
 
   int success;
@@ -50,6 +209,33 @@ ShaderProgram::ShaderProgram(std::initializer_list<unsigned int> shader_ids) {
     glGetProgramInfoLog(id, log_size, nullptr, log.data());
     throw std::runtime_error(std::string { log.begin(), log.end() });
   }
+
+  reflect_uniform_locations();
+}
+
+void ShaderProgram::reflect_uniform_locations() {
+  int uniform_count = 0, max_name_length = 0;
+  glGetProgramInterfaceiv(id, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniform_count);
+  glGetProgramInterfaceiv(id, GL_UNIFORM, GL_MAX_NAME_LENGTH, &max_name_length);
+
+  std::string name(max_name_length, '\0');
+  for (int i = 0; i < uniform_count; ++i) {
+    int name_length = 0;
+    glGetProgramResourceName(id, GL_UNIFORM, i, max_name_length, &name_length, name.data());
+
+    // Uniforms inside blocks report a location of -1 and are skipped.
+    constexpr GLenum property = GL_LOCATION;
+    int location = -1;
+    glGetProgramResourceiv(id, GL_UNIFORM, i, 1, &property, 1, nullptr, &location);
+    if (location != -1) {
+      uniform_locations.emplace(name.substr(0, name_length), location);
+    }
+  }
+}
+
+int ShaderProgram::uniform_location(const std::string& name) const {
+  auto it = uniform_locations.find(name);
+  return (it != uniform_locations.end() ? it->second : -1);
 }
 
 ShaderProgram::~ShaderProgram() {
@@ -62,49 +248,55 @@ void ShaderProgram::use() const {
 
 template <>
 void ShaderProgram::set_uniform<int>(const std::string& name, const int& val) const {
-  glUniform1i(glGetUniformLocation(id, name.c_str()), val);
+  glUniform1i(uniform_location(name), val);
 }
 
 template <>
 void ShaderProgram::set_uniform<unsigned int>(const std::string& name, const unsigned int& val) const {
-  glUniform1ui(glGetUniformLocation(id, name.c_str()), val);
+  glUniform1ui(uniform_location(name), val);
 }
 
 template <>
 void ShaderProgram::set_uniform<float>(const std::string& name, const float& val) const {
-  glUniform1f(glGetUniformLocation(id, name.c_str()), val);
+  glUniform1f(uniform_location(name), val);
 }
 
 template <>
 void ShaderProgram::set_uniform<glm::ivec2>(const std::string& name, const glm::ivec2& val) const {
-  glUniform2iv(glGetUniformLocation(id, name.c_str()), 1, &val[0]);
+  glUniform2iv(uniform_location(name), 1, &val[0]);
 }
 
 template <>
 void ShaderProgram::set_uniform<glm::ivec3>(const std::string& name, const glm::ivec3& val) const {
-  glUniform3iv(glGetUniformLocation(id, name.c_str()), 1, &val[0]);
+  glUniform3iv(uniform_location(name), 1, &val[0]);
 }
 
 template <>
 void ShaderProgram::set_uniform<glm::ivec4>(const std::string& name, const glm::ivec4& val) const {
-  glUniform4iv(glGetUniformLocation(id, name.c_str()), 1, &val[0]);
+  glUniform4iv(uniform_location(name), 1, &val[0]);
 }
 
 template <>
 void ShaderProgram::set_uniform<glm::vec2>(const std::string& name, const glm::vec2& val) const {
-  glUniform2fv(glGetUniformLocation(id, name.c_str()), 1, &val[0]);
+  glUniform2fv(uniform_location(name), 1, &val[0]);
 }
 
 template <>
 void ShaderProgram::set_uniform<glm::vec3>(const std::string& name, const glm::vec3& val) const {
-  glUniform3fv(glGetUniformLocation(id, name.c_str()), 1, &val[0]);
+  glUniform3fv(uniform_location(name), 1, &val[0]);
 }
 
 template <>
 void ShaderProgram::set_uniform<glm::vec4>(const std::string& name, const glm::vec4& val) const {
-  glUniform4fv(glGetUniformLocation(id, name.c_str()), 1, &val[0]);
+  glUniform4fv(uniform_location(name), 1, &val[0]);
 }
 
+GraphicsShaderProgram::GraphicsShaderProgram(const std::string& vertex_source, const std::string& fragment_source, const ProgramCache* cache)
+  : ShaderProgram { { { vertex_source, GL_VERTEX_SHADER }, { fragment_source, GL_FRAGMENT_SHADER } }, cache } {}
+
+ComputeShaderProgram::ComputeShaderProgram(const std::string& compute_source, const ProgramCache* cache)
+  : ShaderProgram { { { compute_source, GL_COMPUTE_SHADER } }, cache } {}
+
 glm::ivec3 ComputeShaderProgram::local_group_size() const {
   glm::ivec3 local_group_size;
   glGetProgramiv(id, GL_COMPUTE_WORK_GROUP_SIZE, reinterpret_cast<GLint*>(&local_group_size));
@@ -1,5 +1,7 @@
 #pragma once
 #include <string>
+#include <initializer_list>
+#include <unordered_map>
 #include <glm/vec3.hpp>
 
 class Shader {
@@ -12,14 +14,43 @@ public:
   Shader(Shader&&) = default;
   Shader& operator=(Shader&&) = default;
 
+  // Expands `#include "name"` lines with the file of that name next to the shader.
   static std::string load_source_from_file(std::string);
 
+  // Inserts the given preprocessor lines right after the #version directive.
+  static std::string insert_defines(const std::string&, std::initializer_list<std::string>);
+
 private:
+  friend class ShaderProgram;
   friend class GraphicsShaderProgram;
   friend class ComputeShaderProgram;
   unsigned int id;
 };
 
+struct ShaderSource {
+  std::string source;
+  unsigned int type;
+};
+
+// On-disk cache of linked program binaries, keyed by the shader sources and the driver that
+// built them, so repeated runs skip GLSL compilation.
+class ProgramCache {
+public:
+  ProgramCache(const std::string& directory);
+
+  std::string key(std::initializer_list<ShaderSource>) const;
+
+  // Returns false if there is no cached binary or the driver rejects it.
+  bool load(unsigned int program, const std::string& key) const;
+  void store(unsigned int program, const std::string& key) const;
+
+private:
+  std::string directory;
+  std::string driver_id;
+
+  std::string path(const std::string& key) const;
+};
+
 class ShaderProgram {
 public:
   ~ShaderProgram();
@@ -34,15 +65,26 @@ public:
   template <typename T>
   void set_uniform(const std::string&, const T&) const;
 
+  // Looked up in the table reflected at link time; -1 if the uniform is not active.
+  int uniform_location(const std::string&) const;
+
 protected:
   ShaderProgram(std::initializer_list<unsigned int>);
+  ShaderProgram(std::initializer_list<ShaderSource>, const ProgramCache*);
   unsigned int id;
+
+private:
+  std::unordered_map<std::string, int> uniform_locations;
+  void link();
+  void reflect_uniform_locations();
 };
 
 class GraphicsShaderProgram : public ShaderProgram {
 public:
   GraphicsShaderProgram(const Shader& vertex_shader, const Shader& fragment_shader)
     : ShaderProgram { { vertex_shader.id, fragment_shader.id } } {}
+
+  GraphicsShaderProgram(const std::string& vertex_source, const std::string& fragment_source, const ProgramCache*);
 };
 
 class ComputeShaderProgram : public ShaderProgram {
@@ -50,5 +92,7 @@ public:
   ComputeShaderProgram(const Shader& compute_shader)
     : ShaderProgram { compute_shader.id } {}
 
+  ComputeShaderProgram(const std::string& compute_source, const ProgramCache*);
+
   glm::ivec3 local_group_size() const;
 };
\ No newline at end of file
@@ -0,0 +1,16 @@
+// Mirrors SimulationParams in application.h, whose size is checked there. Spliced into the compute
+// shaders by Shader::load_source_from_file.
+layout (std140, binding = 0) uniform SimulationParams {
+  ivec2 resolution;
+  uint agent_count;
+  float agent_speed;
+  float turn_speed;
+  float sensor_span;
+  float sensor_range;
+  int sensor_size;
+  float diffuse_rate;
+  float evaporate_rate;
+  float dt;
+  uint seed;
+  float deposit_amount;
+};
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include "sweep.h"
+#include "config_loader.h"
+#include "cpu_engine.h"
+#include "thread_pool.h"
+#include <fmt/core.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#define SWEEP_DELTA_TIME (1.0f / 60.0f)
+
+namespace {
+
+struct SweepAxis {
+  std::string key;
+  std::vector<std::string> values;
+};
+
+std::vector<std::string> split(std::string_view text, char separator) {
+  std::vector<std::string> parts;
+  while (true) {
+    std::size_t end = text.find(separator);
+    parts.emplace_back(text.substr(0, end));
+    if (end == std::string_view::npos) return parts;
+    text.remove_prefix(end + 1);
+  }
+}
+
+std::vector<SweepAxis> parse_sweep(const std::string& sweep) {
+  std::vector<SweepAxis> axes;
+  for (const auto& axis : split(sweep, ';')) {
+    std::size_t equals = axis.find('=');
+    if (equals == std::string::npos || equals == 0 || equals + 1 == axis.size()) {
+      throw std::runtime_error(fmt::format("Expected 'key=value,...' in sweep, got '{}'.", axis));
+    }
+    axes.push_back({ axis.substr(0, equals), split(std::string_view { axis }.substr(equals + 1), ',') });
+  }
+  return axes;
+}
+
+}
+
+std::vector<ApplicationConfig> expand_sweep(const ApplicationConfig& config) {
+  std::vector<ApplicationConfig> configs { config };
+  for (const auto& [key, values] : parse_sweep(config.sweep)) {
+    std::vector<ApplicationConfig> expanded;
+    expanded.reserve(configs.size() * values.size());
+    for (const auto& base : configs) {
+      for (const auto& value : values) {
+        expanded.push_back(base);
+        set_config_value(expanded.back(), key, value);
+      }
+    }
+    configs = std::move(expanded);
+  }
+  return configs;
+}
+
+void run_sweep(const ApplicationConfig& sweep_config) {
+  if (sweep_config.frame_limit == 0) {
+    throw std::runtime_error("A sweep needs a frame_limit.");
+  }
+
+  // Every simulation starts from the same agents unless the sweep itself varies the seed.
+  ApplicationConfig base = sweep_config;
+  if (!base.deterministic) {
+    std::random_device dev;
+    base.seed = dev();
+  }
+
+  auto configs = expand_sweep(base);
+  auto axes = parse_sweep(base.sweep);
+
+  // Checked per simulation, since the sweep may vary these too.
+  for (const auto& config : configs) {
+    if (config.backend != Backend::cpu) {
+      throw std::runtime_error("A sweep needs the cpu backend.");
+    }
+    if (!config.headless) {
+      throw std::runtime_error("A sweep needs headless, it has no window.");
+    }
+    if (config.process_count > 1) {
+      throw std::runtime_error("A sweep runs in one process, it can't be distributed.");
+    }
+    if (!config.record_path.empty()) {
+      throw std::runtime_error("A sweep can't record frames.");
+    }
+    if (!config.checkpoint_path.empty() || config.checkpoint_interval != 0) {
+      throw std::runtime_error("A sweep can't write checkpoints.");
+    }
+    if (!config.restore_path.empty()) {
+      throw std::runtime_error("A sweep can't restore a checkpoint.");
+    }
+    if (config.profile_gpu) {
+      throw std::runtime_error("A sweep has no GPU to profile.");
+    }
+  }
+
+  // The simulations are the parallel tasks, so each engine steps on the thread that owns it.
+  std::vector<std::unique_ptr<CpuEngine>> engines;
+  std::vector<float> step_delta_times;
+  for (auto& config : configs) {
+    config.thread_count = 1;
+    engines.push_back(std::make_unique<CpuEngine>(config));
+    unsigned int substeps = std::max(config.substeps, 1u);
+    step_delta_times.push_back(config.fixed_dt > 0.0f ? config.fixed_dt : SWEEP_DELTA_TIME / substeps);
+  }
+
+  ThreadPool thread_pool { sweep_config.thread_count };
+  auto start_time = std::chrono::steady_clock::now();
+  thread_pool.parallel_for(configs.size(), 1, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      unsigned int step_count = sweep_config.frame_limit * std::max(configs[i].substeps, 1u);
+      for (unsigned int step = 0; step < step_count; ++step) {
+        engines[i]->step(configs[i], step_delta_times[i]);
+      }
+    }
+  });
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+  fmt::println("{} simulations of {} frames in {:.3f}s", configs.size(), sweep_config.frame_limit, elapsed.count());
+
+  std::string header = "simulation";
+  for (const auto& axis : axes) {
+    header += "," + axis.key;
+  }
+  fmt::println("{},trail_mean,trail_stddev", header);
+
+  // Values are printed as they were given, in the order expand_sweep combined them.
+  for (std::size_t i = 0; i < configs.size(); ++i) {
+    std::string row = std::to_string(i);
+    std::size_t stride = configs.size();
+    for (const auto& axis : axes) {
+      stride /= axis.values.size();
+      row += "," + axis.values[i / stride % axis.values.size()];
+    }
+
+    const auto& trail_map = engines[i]->trail_map();
+    double sum = 0.0, sum_squares = 0.0;
+    for (float value : trail_map) {
+      sum += value, sum_squares += static_cast<double>(value) * value;
+    }
+    double mean = sum / trail_map.size();
+    double stddev = std::sqrt(std::max(0.0, sum_squares / trail_map.size() - mean * mean));
+    fmt::println("{},{:.6f},{:.6f}", row, mean, stddev);
+  }
+}
\ No newline at end of file
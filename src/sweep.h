@@ -0,0 +1,14 @@
+#pragma once
+#include "application_config.h"
+#include <vector>
+
+// One config per combination of the values in `config.sweep`; the last key varies fastest.
+// Keys and values are checked like any other config setting.
+std::vector<ApplicationConfig> expand_sweep(const ApplicationConfig&);
+
+// Steps every configuration of the sweep for config.frame_limit frames in one process, each
+// simulation as an independent task of a shared thread pool, then prints one CSV row per
+// simulation with the swept values and the mean and standard deviation of its trail map. Throws
+// for the options a sweep doesn't support: the gpu backend, a window, more than one process,
+// recording, checkpoints and GPU profiling.
+void run_sweep(const ApplicationConfig&);
\ No newline at end of file
@@ -0,0 +1,288 @@
+#include "thread_pool.h"
+#include "numa.h"
+#include <algorithm>
+
+namespace {
+
+// Times a thread without a task yields before it goes to sleep.
+constexpr int idle_spin_count = 64;
+
+}
+
+TaskGraph::Task TaskGraph::add(std::function<void()> fn, std::size_t thread) {
+  nodes.push_back({ std::move(fn), {}, 0, thread, false });
+  return nodes.size() - 1;
+}
+
+TaskGraph::Task TaskGraph::add_pinned(std::size_t thread, std::function<void()> fn) {
+  nodes.push_back({ std::move(fn), {}, 0, thread, true });
+  return nodes.size() - 1;
+}
+
+void TaskGraph::depend(Task task, Task prerequisite) {
+  nodes[prerequisite].successors.push_back(task);
+  ++nodes[task].prerequisite_count;
+}
+
+std::size_t TaskGraph::size() const {
+  return nodes.size();
+}
+
+void TaskGraph::clear() {
+  nodes.clear();
+}
+
+ThreadPool::ThreadPool(unsigned int thread_count, bool pin_to_numa_nodes) {
+  if (thread_count == 0) {
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  NumaTopology topology;
+  if (pin_to_numa_nodes) {
+    topology = numa_topology();
+    // With fewer threads than nodes, the threads take the first nodes.
+    node_total = std::min<std::size_t>(topology.node_count(), thread_count);
+  }
+
+  for (unsigned int i = 0; i < thread_count; ++i) {
+    queues.push_back(std::make_unique<TaskQueue>());
+    thread_nodes.push_back(static_cast<std::size_t>(i) * node_total / thread_count);
+  }
+
+  if (pin_to_numa_nodes) {
+    pin_thread_to_node(topology, thread_nodes[0]);
+  }
+
+  // The thread calling run takes part in the work, so it counts as one of the threads.
+  for (unsigned int i = 1; i < thread_count; ++i) {
+    workers.emplace_back([this, i, pin_to_numa_nodes, topology] {
+      if (pin_to_numa_nodes) {
+        pin_thread_to_node(topology, thread_nodes[i]);
+      }
+      worker_loop(i);
+    });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock { mutex };
+    stopping = true;
+  }
+  wake_condition.notify_all();
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+unsigned int ThreadPool::size() const {
+  return workers.size() + 1;
+}
+
+std::size_t ThreadPool::thread_node(std::size_t thread) const {
+  return thread_nodes[thread];
+}
+
+std::size_t ThreadPool::node_count() const {
+  return node_total;
+}
+
+void ThreadPool::run(TaskGraph& task_graph) {
+  std::size_t task_count = task_graph.nodes.size();
+  if (task_count == 0) return;
+
+  task_graph.pending = std::make_unique<std::atomic<std::size_t>[]>(task_count);
+  task_graph.remaining.store(task_count, std::memory_order_relaxed);
+
+  // The tasks that are ready from the start and have no thread of their own are dealt out in
+  // contiguous runs, so neighbouring chunks of work start out on the same thread.
+  std::vector<TaskGraph::Task> ready;
+  for (TaskGraph::Task task = 0; task < task_count; ++task) {
+    const auto& node = task_graph.nodes[task];
+    task_graph.pending[task].store(node.prerequisite_count, std::memory_order_relaxed);
+    if (node.prerequisite_count != 0) continue;
+
+    if (node.thread != TaskGraph::any_thread) {
+      push_ready(0, task_graph, task);
+    } else {
+      ready.push_back(task);
+    }
+  }
+
+  std::size_t thread_count = queues.size();
+  for (std::size_t thread = 0; thread < thread_count; ++thread) {
+    auto& queue = *queues[thread];
+    std::lock_guard lock { queue.mutex };
+    queue.tasks.insert(
+      queue.tasks.end(),
+      ready.begin() + ready.size() * thread / thread_count,
+      ready.begin() + ready.size() * (thread + 1) / thread_count
+    );
+  }
+
+  if (!workers.empty()) {
+    {
+      std::lock_guard lock { mutex };
+      graph = &task_graph;
+      ++generation;
+    }
+    wake_condition.notify_all();
+  }
+
+  work(0, task_graph);
+
+  // Workers may still be looking for tasks; the graph has to outlive them.
+  if (!workers.empty()) {
+    std::unique_lock lock { mutex };
+    graph = nullptr;
+    idle_condition.wait(lock, [this] { return busy_worker_count == 0; });
+  }
+}
+
+void ThreadPool::for_each_thread(const std::function<void(std::size_t thread)>& fn) {
+  TaskGraph task_graph;
+  for (std::size_t thread = 0; thread < queues.size(); ++thread) {
+    task_graph.add_pinned(thread, [&fn, thread] { fn(thread); });
+  }
+  run(task_graph);
+}
+
+void ThreadPool::parallel_for(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)>& fn) {
+  if (count == 0) return;
+  grain = std::max<std::size_t>(grain, 1);
+
+  TaskGraph task_graph;
+  for (std::size_t begin = 0; begin < count; begin += grain) {
+    task_graph.add([&fn, begin, end = std::min(begin + grain, count)] { fn(begin, end); });
+  }
+  run(task_graph);
+}
+
+void ThreadPool::push_ready(std::size_t thread, TaskGraph& task_graph, TaskGraph::Task task) {
+  const auto& node = task_graph.nodes[task];
+  auto& queue = *queues[node.thread != TaskGraph::any_thread ? node.thread : thread];
+  {
+    std::lock_guard lock { queue.mutex };
+    (node.pinned ? queue.pinned_tasks : queue.tasks).push_back(task);
+  }
+  wake_sleeping();
+}
+
+// Sleeping threads count themselves before they read the epoch and look for tasks one last time,
+// so either a queued task is found or its epoch change is seen by sleep_until_task.
+void ThreadPool::wake_sleeping() {
+  task_epoch.fetch_add(1);
+  if (sleeping_count.load() != 0) {
+    task_epoch.notify_all();
+  }
+}
+
+// Whether the thread could take a task: one of its own, or one it could steal.
+bool ThreadPool::has_task(std::size_t thread) {
+  for (std::size_t i = 0; i < queues.size(); ++i) {
+    auto& queue = *queues[i];
+    std::lock_guard lock { queue.mutex };
+    if (!queue.tasks.empty() || (i == thread && !queue.pinned_tasks.empty())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::sleep_until_task(std::size_t thread, TaskGraph& task_graph) {
+  sleeping_count.fetch_add(1);
+  std::size_t epoch = task_epoch.load();
+  if (task_graph.remaining.load() != 0 && !has_task(thread)) {
+    task_epoch.wait(epoch);
+  }
+  sleeping_count.fetch_sub(1);
+}
+
+// Takes the thread's pinned tasks first and then the newest task of its own deque, or else steals
+// the oldest task of the next thread along that has one, looking on the thread's own node first.
+bool ThreadPool::next_task(std::size_t thread, TaskGraph::Task& task) {
+  {
+    auto& queue = *queues[thread];
+    std::lock_guard lock { queue.mutex };
+    for (auto* tasks : { &queue.pinned_tasks, &queue.tasks }) {
+      if (!tasks->empty()) {
+        task = tasks->back();
+        tasks->pop_back();
+        return true;
+      }
+    }
+  }
+
+  for (bool same_node : { true, false }) {
+    for (std::size_t i = 1; i < queues.size(); ++i) {
+      std::size_t victim = (thread + i) % queues.size();
+      if ((thread_nodes[victim] == thread_nodes[thread]) != same_node) continue;
+
+      auto& queue = *queues[victim];
+      std::lock_guard lock { queue.mutex };
+      if (!queue.tasks.empty()) {
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+// Runs tasks until the whole graph has run. A finished task hands the successors it made ready to
+// the thread that ran it, unless they have a thread of their own.
+void ThreadPool::work(std::size_t thread, TaskGraph& task_graph) {
+  int idle_spins = 0;
+  while (task_graph.remaining.load(std::memory_order_acquire) != 0) {
+    TaskGraph::Task task;
+    if (!next_task(thread, task)) {
+      // The remaining tasks are running or waiting for ones that are.
+      if (++idle_spins < idle_spin_count) {
+        std::this_thread::yield();
+      } else {
+        sleep_until_task(thread, task_graph);
+        idle_spins = 0;
+      }
+      continue;
+    }
+    idle_spins = 0;
+
+    auto& node = task_graph.nodes[task];
+    node.fn();
+
+    for (TaskGraph::Task successor : node.successors) {
+      if (task_graph.pending[successor].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        push_ready(thread, task_graph, successor);
+      }
+    }
+    if (task_graph.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      wake_sleeping();
+    }
+  }
+}
+
+void ThreadPool::worker_loop(std::size_t thread) {
+  std::size_t seen_generation = 0;
+  while (true) {
+    TaskGraph* task_graph;
+    {
+      std::unique_lock lock { mutex };
+      wake_condition.wait(lock, [&] { return stopping || (graph != nullptr && generation != seen_generation); });
+      if (stopping) return;
+      seen_generation = generation;
+      task_graph = graph;
+      ++busy_worker_count;
+    }
+
+    work(thread, *task_graph);
+
+    {
+      std::lock_guard lock { mutex };
+      --busy_worker_count;
+    }
+    idle_condition.notify_all();
+  }
+}
\ No newline at end of file
@@ -0,0 +1,109 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <limits>
+#include <cstddef>
+
+// Tasks and the dependency edges between them, run by ThreadPool::run. A task starts once every
+// task it depends on has finished, so no pass needs a barrier across the whole pool.
+class TaskGraph {
+public:
+  using Task = std::size_t;
+  static constexpr std::size_t any_thread = std::numeric_limits<std::size_t>::max();
+
+  // A task placed on a thread is queued there once it is ready, but may still be stolen; a pinned
+  // task only ever runs on its thread. Other tasks queue on the thread that made them ready.
+  Task add(std::function<void()>, std::size_t thread = any_thread);
+  Task add_pinned(std::size_t thread, std::function<void()>);
+  // `task` starts only after `prerequisite` has finished.
+  void depend(Task task, Task prerequisite);
+
+  std::size_t size() const;
+  void clear();
+
+private:
+  friend class ThreadPool;
+
+  struct Node {
+    std::function<void()> fn;
+    std::vector<Task> successors;
+    std::size_t prerequisite_count = 0;
+    std::size_t thread = any_thread;
+    bool pinned = false;
+  };
+
+  std::vector<Node> nodes;
+  std::unique_ptr<std::atomic<std::size_t>[]> pending;
+  std::atomic<std::size_t> remaining = 0;
+};
+
+// Every thread owns a deque of ready tasks. It takes its newest task first, so a task freed by the
+// one it just finished runs on a warm cache, and when its deque runs dry it steals the oldest task
+// of another thread. The thread calling run or parallel_for works as thread 0. A thread that
+// finds no task spins briefly and then sleeps until one is queued, so a long task running alone,
+// such as one waiting on another process, doesn't keep the rest of the pool busy.
+//
+// A pool pinned to NUMA nodes deals its threads out over the nodes in contiguous blocks and
+// restricts each to the CPUs of its node, the thread creating the pool included, as it works as
+// thread 0. Threads steal from their own node before they steal across nodes.
+class ThreadPool {
+public:
+  ThreadPool(unsigned int thread_count = 0, bool pin_to_numa_nodes = false);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ThreadPool(ThreadPool&&) = delete;
+  ThreadPool& operator=(ThreadPool&&) = delete;
+
+  unsigned int size() const;
+  // The node a thread is pinned to; always 0 in a pool that isn't pinned.
+  std::size_t thread_node(std::size_t thread) const;
+  std::size_t node_count() const;
+
+  // Blocks until every task of the graph has run. One graph runs at a time.
+  void run(TaskGraph&);
+
+  // Splits [0, count) into chunks of `grain` and blocks until fn(begin, end) has run for all of them.
+  void parallel_for(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)>&);
+  // Blocks until fn(thread) has run once on every thread of the pool.
+  void for_each_thread(const std::function<void(std::size_t thread)>&);
+
+private:
+  struct TaskQueue {
+    std::mutex mutex;
+    std::deque<TaskGraph::Task> tasks;
+    std::deque<TaskGraph::Task> pinned_tasks;
+  };
+
+  std::vector<std::thread> workers;
+  std::vector<std::unique_ptr<TaskQueue>> queues;
+  std::vector<std::size_t> thread_nodes;
+  std::size_t node_total = 1;
+
+  std::mutex mutex;
+  std::condition_variable wake_condition;
+  std::condition_variable idle_condition;
+  TaskGraph* graph = nullptr;
+  std::size_t generation = 0;
+  std::size_t busy_worker_count = 0;
+  bool stopping = false;
+
+  // Changes whenever a task is queued or a graph finishes; idle threads sleep on it.
+  std::atomic<std::size_t> task_epoch = 0;
+  std::atomic<std::size_t> sleeping_count = 0;
+
+  void push_ready(std::size_t thread, TaskGraph&, TaskGraph::Task);
+  void wake_sleeping();
+  bool has_task(std::size_t thread);
+  void sleep_until_task(std::size_t thread, TaskGraph&);
+  bool next_task(std::size_t thread, TaskGraph::Task&);
+  void work(std::size_t thread, TaskGraph&);
+  void worker_loop(std::size_t thread);
+};
\ No newline at end of file